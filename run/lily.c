@@ -23,6 +23,8 @@ static void usage()
           "  -l            local imports only (don't use system dirs)\n"
           "  -gstart N     # of values to allow before a gc sweep\n"
           "  -gmul N       (# allowed * N) when sweep can't free anything\n"
+          "  -profile      print dispatch counts to stderr after running\n"
+          "  -sample N     print a stack every N calls and jumps (collapsed)\n"
           "  --            stop handling options\n"
           "  -v            show version information\n"
           "  -h            show this help\n"
@@ -54,6 +56,8 @@ int is_file;
 int gc_start = -1;
 int gc_multiplier = -1;
 int use_sys_dirs = 1;
+int do_profile = 0;
+int sample_interval = 0;
 char *to_process = NULL;
 
 static void process_args(int argc, char **argv, int *argc_offset)
@@ -81,6 +85,12 @@ static void process_args(int argc, char **argv, int *argc_offset)
             }
             else if (arg_equal("-l"))
                 use_sys_dirs = 0;
+            else if (arg_equal("-profile"))
+                do_profile = 1;
+            else if (arg_equal("-sample")) {
+                CHECK_NEXT
+                sample_interval = atoi(argv[i]);
+            }
             else if (arg_equal("--")) {
                 /* The repl safely handles i == argc. */
                 i++;
@@ -122,6 +132,9 @@ int main(int argc, char **argv)
 
     lily_state *state = lily_new_state(&config);
 
+    if (sample_interval > 0)
+        lily_profile_sample_every(state, (uint32_t)sample_interval);
+
     if (to_process == NULL)
         exit(lily_repl(state));
 
@@ -138,6 +151,19 @@ int main(int argc, char **argv)
     if (result == 0)
         fputs(lily_error_message(state), stderr);
 
+    if (do_profile) {
+        const char *report = lily_profile_report(state);
+
+        if (report)
+            fputs(report, stderr);
+        else
+            fputs("lily: -profile requires a build with WITH_PROFILE\n",
+                  stderr);
+    }
+
+    if (sample_interval > 0)
+        fputs(lily_profile_collapsed(state), stderr);
+
     int exit_code = lily_exit_code(state);
 
     lily_free_state(state);
@@ -142,6 +142,13 @@ typedef void (*lily_call_entry_func)(lily_state *);
 //                     The interpreter expects that the specified directories
 //                     are reasonable and well-formed. On Windows, the
 //                     directories are processed.
+//
+//     optimize      - (Default: 1)
+//                     If set to 1, each function's code is run through a
+//                     peephole pass once it is done. The pass threads jumps,
+//                     removes stores that are never read, and removes moves
+//                     that do nothing. Set this to 0 to get the code exactly
+//                     as the emitter wrote it.
 typedef struct lily_config_ {
     int argc;
     char **argv;
@@ -156,6 +163,7 @@ typedef struct lily_config_ {
     int sandbox;
     int use_sys_dirs;
     char *sys_dirs;
+    int optimize;
 } lily_config;
 
 // Function: lily_config_init
@@ -671,6 +679,10 @@ uint32_t lily_bytestring_length(lily_bytestring_val *byte_val);
 // somewhere). The caller can therefore use the result of this function as part
 // of an expression without worrying about a leak.
 //
+// Elements are stored inside the container. If 'con' is a List, anything that
+// adds to it (including calling back into the interpreter) may move the
+// elements, so the result should be fetched again afterward.
+//
 // No safety checking is performed on the index given.
 //
 // Parameters:
@@ -1155,6 +1167,11 @@ void                lily_push_string_sized (lily_state *s, const char *source,
 // constructor should only initialize slots 0 and 1 (the message and traceback,
 // respectively). It should not worry about initialization of other slots.
 //
+// Slot 1 of an Exception is always a List[String]. When an exception is caught,
+// the interpreter puts an empty List there and keeps the frames elsewhere. The
+// traceback is built from them the first time Lily code reads it, unless slot 1
+// was replaced before then.
+//
 // This does not handle foreign classes inheriting other foreign classes,
 // because the language does not support that (intentionally).
 lily_container_val *lily_push_super        (lily_state *s, uint16_t class_id,
@@ -1660,6 +1677,10 @@ lily_destroy_func destroy_func;
 // Make all predefined libraries available.
 void lily_open_all_libraries(lily_state *);
 
+// Function: lily_open_bench_library
+// Make the bench library available.
+void lily_open_bench_library(lily_state *);
+
 // Function: lily_open_coroutine_library
 // Make the coroutine library available.
 void lily_open_coroutine_library(lily_state *);
@@ -1672,6 +1693,10 @@ void lily_open_fs_library(lily_state *);
 // Make the introspect library available.
 void lily_open_introspect_library(lily_state *);
 
+// Function: lily_open_io_library
+// Make the io library available.
+void lily_open_io_library(lily_state *);
+
 // Function: lily_open_math_library
 // Make the math library available.
 void lily_open_math_library(lily_state *);
@@ -1688,6 +1713,10 @@ void lily_open_subprocess_library(lily_state *);
 // Make the sys library available.
 void lily_open_sys_library(lily_state *);
 
+// Function: lily_open_thread_library
+// Make the thread library available.
+void lily_open_thread_library(lily_state *);
+
 // Function: lily_open_time_library
 // Make the time library available.
 void lily_open_time_library(lily_state *);
@@ -1696,6 +1725,64 @@ void lily_open_time_library(lily_state *);
 // Make the UTF-8 library available.
 void lily_open_utf8_library(lily_state *);
 
+/////////////////////
+// Section: Profiling
+/////////////////////
+// Dispatch counters for finding hot code.
+//
+// The interpreter only keeps counters if it was built with profiling enabled
+// (cmake -DWITH_PROFILE=ON, which defines LILY_WITH_PROFILE). A profiling
+// build counts every opcode dispatched, and for each function, how many times
+// it was called and how many dispatches were made inside of it. Dispatches are
+// also attributed to the line they were written for.
+//
+// Any build can also sample the call stack every so many calls and jumps.
+// Sampling is off by default, and only checks a countdown at calls and jumps,
+// so it can be left on in production. The output can be turned into a
+// flamegraph.
+//
+// Counters for `__main__` are reset when a new parse begins, because the
+// code they refer to is replaced.
+
+// Function: lily_profile_report
+// Build a report of the interpreter's dispatch counters.
+//
+// The report has three sections: Opcodes, functions, and the hottest lines.
+// Each section is sorted by dispatch count, from highest to lowest.
+//
+// The result is a pointer to a msgbuf inside of the interpreter. The pointer
+// is valid until the interpreter is used again.
+//
+// Returns NULL if the interpreter was not built with profiling enabled.
+const char *lily_profile_report(lily_state *s);
+
+// Function: lily_profile_reset
+// Set every dispatch counter back to zero, and discard any stacks that the
+// sampler has recorded.
+//
+// Interpreters not built with profiling enabled only discard the stacks.
+void lily_profile_reset(lily_state *s);
+
+// Function: lily_profile_sample_every
+// Record the call stack each time 'count' calls and jumps are made.
+//
+// Every loop jumps each time around, so code can't run for long without
+// counting down. Each sample includes both native and foreign functions.
+// Native functions are listed with the line they are on. Passing 0 turns the
+// sampler off, which is the default.
+void lily_profile_sample_every(lily_state *s, uint32_t count);
+
+// Function: lily_profile_collapsed
+// Build a list of the stacks that the sampler recorded.
+//
+// Each line has a stack (outermost function first, separated by ';'), then a
+// space, then how many times that stack was seen. This is the collapsed
+// format that flamegraph tools accept.
+//
+// The result is a pointer to a msgbuf inside of the interpreter. The pointer
+// is valid until the interpreter is used again.
+const char *lily_profile_collapsed(lily_state *s);
+
 /////////////////////////
 // Section: Miscellaneous
 /////////////////////////
@@ -13,7 +13,7 @@
    Functions from lily_value.h come before those in lily.h. Definitions in this
    file should have the same order as the matching header files. */
 
-extern lily_gc_entry *lily_gc_stopper;
+extern lily_gc_entry *const lily_gc_stopper;
 
 void lily_destroy_hash(lily_value *);
 void lily_destroy_vm(lily_vm_state *);
@@ -23,10 +23,16 @@ void lily_vm_grow_registers(lily_vm_state *, uint16_t);
 /* Raw value creation. */
 
 
-static lily_string_val *new_sv(char *buffer, int size)
+/* The buffer of a String or ByteString is in the same block, right after it.
+   That makes each one a single allocation. */
+static lily_string_val *new_sv(const char *source, int size)
 {
-    lily_string_val *sv = lily_malloc(sizeof(*sv));
+    lily_string_val *sv = lily_malloc(sizeof(*sv) +
+            (size + 1) * sizeof(*sv->string));
+    char *buffer = (char *)(sv + 1);
 
+    memcpy(buffer, source, size);
+    buffer[size] = '\0';
     sv->refcount = 1;
     sv->string = buffer;
     sv->size = size;
@@ -35,21 +41,12 @@ static lily_string_val *new_sv(char *buffer, int size)
 
 lily_bytestring_val *lily_new_bytestring_raw(const char *source, int len)
 {
-    char *buffer = lily_malloc((len + 1) * sizeof(*buffer));
-
-    memcpy(buffer, source, len);
-    buffer[len] = '\0';
-    return (lily_bytestring_val *)new_sv(buffer, len);
+    return (lily_bytestring_val *)new_sv(source, len);
 }
 
 lily_string_val *lily_new_string_raw(const char *source)
 {
-    size_t len = strlen(source);
-    char *buffer = lily_malloc((len + 1) * sizeof(*buffer));
-
-    strcpy(buffer, source);
-
-    return new_sv(buffer, (int)len);
+    return new_sv(source, (int)strlen(source));
 }
 
 lily_container_val *lily_new_container_raw(uint16_t class_id,
@@ -67,12 +64,31 @@ lily_container_val *lily_new_container_raw(uint16_t class_id,
 
     uint32_t i;
 
-    for (i = 0;i < num_values;i++) {
-        lily_value *elem = lily_malloc(sizeof(*elem));
+    for (i = 0;i < num_values;i++)
+        cv->values[i].flags = 0;
 
-        elem->flags = 0;
-        cv->values[i] = elem;
-    }
+    return cv;
+}
+
+/* Variants never change size, so each is made as one block: The container,
+   then the values. This makes a variant cost one allocation instead of two. */
+lily_container_val *lily_new_variant_raw(uint16_t class_id, uint32_t num_values)
+{
+    lily_container_val *cv = lily_malloc(sizeof(*cv) +
+            num_values * sizeof(*cv->values));
+
+    cv->values = (lily_value *)(cv + 1);
+    cv->refcount = 1;
+    cv->num_values = num_values;
+    cv->extra_space = 0;
+    cv->instance_ctor_need = 0;
+    cv->class_id = class_id;
+    cv->gc_entry = NULL;
+
+    uint32_t i;
+
+    for (i = 0;i < num_values;i++)
+        cv->values[i].flags = 0;
 
     return cv;
 }
@@ -93,12 +109,8 @@ lily_vt_container_val *lily_new_vt_container_raw(uint16_t class_id,
 
     uint32_t i;
 
-    for (i = 0;i < num_values;i++) {
-        lily_value *elem = lily_malloc(sizeof(*elem));
-
-        elem->flags = 0;
-        vcv->values[i] = elem;
-    }
+    for (i = 0;i < num_values;i++)
+        vcv->values[i].flags = 0;
 
     return vcv;
 }
@@ -130,14 +142,18 @@ lily_value *lily_stack_take(lily_state *s)
 
 void lily_value_assign(lily_value *left, lily_value *right)
 {
-    if (right->flags & VAL_IS_DEREFABLE)
-        right->value.generic->refcount++;
+    /* 'right' may be inside of a container that dies when 'left' is deref'd. */
+    lily_raw_value raw = right->value;
+    uint32_t flags = right->flags;
+
+    if (flags & VAL_IS_DEREFABLE)
+        raw.generic->refcount++;
 
     if (left->flags & VAL_IS_DEREFABLE)
         lily_deref(left);
 
-    left->value = right->value;
-    left->flags = right->flags;
+    left->value = raw;
+    left->flags = flags;
 }
 
 uint16_t lily_value_class_id(lily_value *value)
@@ -159,8 +175,8 @@ static int subvalue_eq(lily_state *s, int *depth, lily_value *left,
     if (left_list->num_values == right_list->num_values) {
         ok = 1;
         for (i = 0;i < left_list->num_values;i++) {
-            lily_value *left_item = left_list->values[i];
-            lily_value *right_item = right_list->values[i];
+            lily_value *left_item = &left_list->values[i];
+            lily_value *right_item = &right_list->values[i];
             (*depth)++;
             if (lily_value_compare_raw(s, depth, left_item, right_item) == 0) {
                 (*depth)--;
@@ -189,8 +205,9 @@ int lily_value_compare_raw(lily_state *s, int *depth, lily_value *left,
     else if (left_base == LILY_ID_DOUBLE)
         return left->value.doubleval == right->value.doubleval;
     else if (left_base == LILY_ID_STRING)
-        return strcmp(left->value.string->string,
-                right->value.string->string) == 0;
+        return left->value.string == right->value.string ||
+               strcmp(left->value.string->string,
+                      right->value.string->string) == 0;
     else if (left_base == LILY_ID_BYTESTRING) {
         lily_string_val *left_sv = left->value.string;
         lily_string_val *right_sv = right->value.string;
@@ -292,14 +309,19 @@ static void destroy_container(lily_value *v)
             iv->gc_entry->value.generic = NULL;
     }
 
+    /* Instances don't have spare space like a List. Instead, a caught
+       exception may have hidden values after the properties (see vm's
+       store_exception_into). Variants always have 0 here. */
+    uint32_t count = iv->num_values + iv->extra_space;
     uint32_t i;
 
-    for (i = 0;i < iv->num_values;i++) {
-        lily_deref(iv->values[i]);
-        lily_free(iv->values[i]);
-    }
+    for (i = 0;i < count;i++)
+        lily_deref(&iv->values[i]);
 
-    lily_free(iv->values);
+    /* Variants hold their values in the same block (see lily_new_variant_raw),
+       so there's only the one free at the end. */
+    if ((v->flags & V_VARIANT_FLAG) == 0)
+        lily_free(iv->values);
 
     if (full_destroy)
         lily_free(iv);
@@ -360,10 +382,8 @@ static void destroy_list(lily_value *v)
     lily_container_val *lv = v->value.container;
     uint32_t i;
 
-    for (i = 0;i < lv->num_values;i++) {
-        lily_deref(lv->values[i]);
-        lily_free(lv->values[i]);
-    }
+    for (i = 0;i < lv->num_values;i++)
+        lily_deref(&lv->values[i]);
 
     lily_free(lv->values);
     lily_free(lv);
@@ -421,10 +441,7 @@ static void destroy_function(lily_value *v)
 
 static void destroy_string(lily_value *v)
 {
-    lily_string_val *sv = v->value.string;
-
-    lily_free(sv->string);
-    lily_free(sv);
+    lily_free(v->value.string);
 }
 
 void lily_value_destroy(lily_value *v)
@@ -486,18 +503,18 @@ uint32_t lily_bytestring_length(lily_bytestring_val *sv)
 
 lily_value *lily_con_get(lily_container_val *c, uint32_t index)
 {
-    return c->values[index];
+    return &c->values[index];
 }
 
 void lily_con_set(lily_container_val *c, uint32_t index, lily_value *v)
 {
-    lily_value_assign(c->values[index], v);
+    lily_value_assign(&c->values[index], v);
 }
 
 void lily_con_set_from_stack(lily_state *s, lily_container_val *c,
         uint32_t index)
 {
-    lily_value *target = c->values[index];
+    lily_value *target = &c->values[index];
 
     if (target->flags & VAL_IS_DEREFABLE)
         lily_deref(target);
@@ -574,6 +591,12 @@ static void grow_list(lily_container_val *lv)
 
 void lily_list_insert(lily_container_val *c, uint32_t index, lily_value *v)
 {
+    /* 'v' may be an element of this List, so copy it before growing. */
+    lily_value copy = *v;
+
+    if (copy.flags & VAL_IS_DEREFABLE)
+        copy.value.generic->refcount++;
+
     if (c->extra_space == 0)
         grow_list(c);
 
@@ -581,7 +604,7 @@ void lily_list_insert(lily_container_val *c, uint32_t index, lily_value *v)
         memmove(c->values + index + 1, c->values + index,
                 (c->num_values - index) * sizeof(*c->values));
 
-    c->values[index] = lily_value_copy(v);
+    c->values[index] = copy;
     c->num_values++;
     c->extra_space--;
 }
@@ -605,21 +628,15 @@ void lily_list_reserve(lily_container_val *c, uint32_t new_size)
 
 void lily_list_push(lily_container_val *c, lily_value *v)
 {
-    if (c->extra_space == 0)
-        grow_list(c);
-
-    c->values[c->num_values] = lily_value_copy(v);
-    c->num_values++;
-    c->extra_space--;
+    lily_list_insert(c, c->num_values, v);
 }
 
 void lily_list_take(lily_state *s, lily_container_val *c, uint32_t index)
 {
-    lily_value *v = c->values[index];
+    lily_value *v = &c->values[index];
     lily_push_value(s, v);
 
     lily_deref(v);
-    lily_free(v);
 
     if (index != c->num_values)
         memmove(c->values + index, c->values + index + 1,
@@ -824,12 +841,7 @@ void lily_push_boolean(lily_state *s, int v)
 void lily_push_bytestring(lily_state *s, const char *source, int len)
 {
     PUSH_PREAMBLE
-    char *buffer = lily_malloc((len + 1) * sizeof(*buffer));
-
-    memcpy(buffer, source, len);
-    buffer[len] = '\0';
-
-    lily_string_val *sv = new_sv(buffer, len);
+    lily_string_val *sv = new_sv(source, len);
 
     SET_TARGET(V_BYTESTRING_FLAG | LILY_ID_BYTESTRING | VAL_IS_DEREFABLE, string, sv);
 }
@@ -943,12 +955,7 @@ lily_container_val *lily_push_super(lily_state *s, uint16_t id,
 void lily_push_string(lily_state *s, const char *source)
 {
     PUSH_PREAMBLE
-    size_t len = strlen(source);
-    char *buffer = lily_malloc((len + 1) * sizeof(*buffer));
-
-    strcpy(buffer, source);
-
-    lily_string_val *sv = new_sv(buffer, (int)len);
+    lily_string_val *sv = new_sv(source, (int)strlen(source));
 
     SET_TARGET(LILY_ID_STRING | V_STRING_FLAG | VAL_IS_DEREFABLE, string, sv);
 }
@@ -956,11 +963,7 @@ void lily_push_string(lily_state *s, const char *source)
 void lily_push_string_sized(lily_state *s, const char *source, int len)
 {
     PUSH_PREAMBLE
-    char *buffer = lily_malloc((len + 1) * sizeof(*buffer));
-    memcpy(buffer, source, len);
-    buffer[len] = '\0';
-
-    lily_string_val *sv = new_sv(buffer, len);
+    lily_string_val *sv = new_sv(source, len);
 
     SET_TARGET(LILY_ID_STRING | V_STRING_FLAG | VAL_IS_DEREFABLE, string, sv);
 }
@@ -994,7 +997,11 @@ void lily_push_value(lily_state *s, lily_value *v)
 
 lily_container_val *lily_push_variant(lily_state *s, uint16_t id, uint32_t size)
 {
-    PUSH_CONTAINER(id, V_VARIANT_FLAG, size);
+    PUSH_PREAMBLE
+    lily_container_val *c = lily_new_variant_raw(id, size);
+    SET_TARGET(id | VAL_IS_DEREFABLE | VAL_IS_GC_SPECULATIVE | V_VARIANT_FLAG,
+            container, c);
+    return c;
 }
 
 
@@ -1043,8 +1050,8 @@ void lily_return_some_of_top(lily_state *s)
     if (target->flags & VAL_IS_DEREFABLE)
         lily_deref(target);
 
-    lily_container_val *variant = lily_new_container_raw(LILY_ID_SOME, 1);
-    lily_value *entry = variant->values[0];
+    lily_container_val *variant = lily_new_variant_raw(LILY_ID_SOME, 1);
+    lily_value *entry = &variant->values[0];
     lily_value *top = *(s->call_chain->top - 1);
 
     /* Transfer top into the floating variant. */
@@ -1059,12 +1066,7 @@ void lily_return_some_of_top(lily_state *s)
 void lily_return_string(lily_state *s, const char *value)
 {
     RETURN_PREAMBLE
-    size_t len = strlen(value);
-    char *buffer = lily_malloc((len + 1) * sizeof(*buffer));
-
-    strcpy(buffer, value);
-
-    lily_string_val *sv = new_sv(buffer, (int)len);
+    lily_string_val *sv = new_sv(value, (int)strlen(value));
 
     SET_TARGET(LILY_ID_STRING | V_STRING_FLAG | VAL_IS_DEREFABLE, string, sv);
 }
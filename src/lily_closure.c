@@ -231,6 +231,15 @@ void lily_cl_transform(lily_emit_state *emit, lily_block *scope_block,
         }
     }
 
+    /* Catch table entries are positions in code, so they need to be moved
+       along with the code. Treat them like jump destinations. */
+    uint16_t catch_start = scope_block->catch_start;
+    uint16_t catch_stop = lily_u16_pos(emit->catch_table);
+
+    for (i = catch_start;i < catch_stop;i++)
+        maybe_add_jump(emit->patches, patch_start,
+                lily_u16_get(emit->catch_table, i));
+
     /* Add an impossible jump to act as a terminator. */
     lily_u16_write_2(emit->patches, UINT16_MAX, 0);
 
@@ -359,5 +368,21 @@ void lily_cl_transform(lily_emit_state *emit, lily_block *scope_block,
         }
     }
 
+    for (j = catch_start;j < catch_stop;j++) {
+        uint16_t original = lily_u16_get(emit->catch_table, j);
+        int k;
+
+        for (k = patch_start;k < patch_stop;k += 2) {
+            if (original == lily_u16_get(emit->patches, k)) {
+                /* Include upvalue reads, same as jumps do. */
+                int tx_offset = count_transforms(emit, original) * 4;
+
+                lily_u16_set_at(emit->catch_table, j,
+                        lily_u16_get(emit->patches, k + 1) - tx_offset);
+                break;
+            }
+        }
+    }
+
     lily_u16_set_pos(emit->patches, patch_start);
 }
@@ -65,7 +65,9 @@ int lily_ci_next(lily_code_iter *iter)
         case o_number_divide:
         case o_number_minus:
         case o_number_multiply:
-        case o_subscript_get:
+        case o_bytestring_get:
+        case o_hash_get:
+        case o_list_get:
             iter->inputs_3 = 2;
             iter->outputs_4 = 1;
             iter->line_6 = 1;
@@ -96,6 +98,7 @@ int lily_ci_next(lily_code_iter *iter)
         case o_call_foreign:
         case o_call_native:
         case o_call_register:
+        case o_call_virt:
             iter->special_1 = 1;
             iter->counter_2 = 1;
             iter->inputs_3 = buffer[2];
@@ -118,6 +121,7 @@ int lily_ci_next(lily_code_iter *iter)
             break;
         case o_build_list:
         case o_build_tuple:
+        case o_build_tuple_local:
         case o_interpolation:
             iter->counter_2 = 1;
             iter->inputs_3 = buffer[1];
@@ -141,12 +145,22 @@ int lily_ci_next(lily_code_iter *iter)
 
             iter->round_total = 6;
             break;
-        case o_subscript_set:
+        case o_bytestring_set:
+        case o_hash_set:
+        case o_list_set:
             iter->inputs_3 = 3;
             iter->line_6 = 1;
 
             iter->round_total = 5;
             break;
+        case o_hash_get_literal:
+            iter->special_1 = 5;
+            iter->inputs_3 = 1;
+            iter->outputs_4 = 1;
+            iter->line_6 = 1;
+
+            iter->round_total = 9;
+            break;
         case o_closure_set:
         case o_global_set:
             iter->special_1 = 1;
@@ -172,8 +186,10 @@ int lily_ci_next(lily_code_iter *iter)
 
             iter->round_total = 4;
             break;
+        case o_list_get_literal:
         case o_property_get:
         case o_virt_get:
+        case o_traceback_get:
             iter->special_1 = 1;
             iter->inputs_3 = 1;
             iter->outputs_4 = 1;
@@ -181,6 +197,7 @@ int lily_ci_next(lily_code_iter *iter)
 
             iter->round_total = 5;
             break;
+        case o_list_set_literal:
         case o_property_set:
             iter->special_1 = 1;
             iter->inputs_3 = 2;
@@ -188,13 +205,6 @@ int lily_ci_next(lily_code_iter *iter)
 
             iter->round_total = 5;
             break;
-        case o_catch_push:
-            iter->jumps_5 = 1;
-            iter->line_6 = 1;
-
-            iter->round_total = 3;
-            break;
-        case o_catch_pop:
         case o_vm_exit:
 
             iter->round_total = 1;
@@ -395,6 +395,12 @@ typedef struct lily_proto_ {
        these positions ensures that the cells are fresh on each invocation. */
     uint16_t *locals;
 
+    /* If the function has try blocks, this is a table of where they are. The
+       first element is the size of the table. After that, each try block has a
+       start, an end, and the position of its first except. Inner try blocks
+       come before outer ones. This is NULL if there are no try blocks. */
+    uint16_t *catch_table;
+
     /* This points to the code that the function is using. This makes it easier
        to free code, since there may be multiple closure function vals pointing
        at the same code. */
@@ -407,6 +413,22 @@ typedef struct lily_proto_ {
        The array is backed by a single string position 0 holding the start of
        that string. When freeing keywords, free that and then keywords. */
     char **keywords;
+
+    /* How many instructions the optimizer changed or removed. */
+    uint16_t optimize_count;
+
+#ifdef LILY_WITH_PROFILE
+    /* Profiling builds only. Dispatch counts for each code position, or NULL
+       if the function hasn't run yet. */
+    uint64_t *profile_hits;
+
+    /* How many times the function has been called. */
+    uint64_t profile_calls;
+
+    /* How many positions profile_hits has. */
+    uint32_t profile_hits_len;
+    uint32_t profile_pad;
+#endif
 } lily_proto;
 
 
@@ -557,6 +579,9 @@ typedef struct lily_proto_ {
 /* Virtual methods can be redefined by a child class. */
 #define VAR_IS_VIRTUAL        0x40
 
+/* This foreign function can be called by several threads at once. */
+#define VAR_IS_PARALLEL       0x80
+
 /* lily_variant_class uses the flags for lily_class. */
 
 
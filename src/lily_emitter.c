@@ -6,13 +6,14 @@
 #include "lily_closure.h"
 #include "lily_emitter.h"
 #include "lily_opcode.h"
+#include "lily_optimize.h"
 #include "lily_parser.h"
 
-extern lily_type *lily_question_type;
-extern lily_type *lily_scoop_type;
-extern lily_class *lily_self_class;
-extern lily_type *lily_unit_type;
-extern lily_type *lily_unset_type;
+extern lily_type *const lily_question_type;
+extern lily_type *const lily_scoop_type;
+extern lily_class *const lily_self_class;
+extern lily_type *const lily_unit_type;
+extern lily_type *const lily_unset_type;
 
 /***
  *      ____       _
@@ -35,6 +36,7 @@ lily_emit_state *lily_new_emit_state(lily_symtab *symtab, lily_raiser *raiser)
     lily_block *main_block = lily_malloc(sizeof(*main_block));
 
     emit->block = main_block;
+    emit->catch_table = lily_new_buffer_u16(4);
     emit->closure_aux_code = NULL;
     emit->closure_spots = lily_new_buffer_u16(4);
     emit->code = lily_new_buffer_u16(32);
@@ -56,6 +58,7 @@ lily_emit_state *lily_new_emit_state(lily_symtab *symtab, lily_raiser *raiser)
     emit->ts = lily_new_type_system(emit->tm);
 
     main_block->block_type = block_file;
+    main_block->catch_start = 0;
     main_block->code_start = 0;
     main_block->forward_class_count = 0;
     main_block->forward_count = 0;
@@ -105,6 +108,7 @@ void lily_rewind_emit_state(lily_emit_state *emit)
     emit->current_class = NULL;
     emit->function_depth = 1;
     emit->scope_block = main_block;
+    lily_u16_set_pos(emit->catch_table, 0);
     lily_u16_set_pos(emit->closure_spots, 0);
     lily_u16_set_pos(emit->code, 0);
     lily_u16_set_pos(emit->match_cases, 0);
@@ -132,6 +136,7 @@ void lily_free_emit_state(lily_emit_state *emit)
     free_storage_stack(emit->storages);
     free_storage_stack(emit->self_storages);
     lily_free(emit->transform_table);
+    lily_free_buffer_u16(emit->catch_table);
     lily_free_buffer_u16(emit->closure_spots);
     lily_free_buffer_u16(emit->code);
     lily_free_buffer_u16(emit->match_cases);
@@ -276,31 +281,6 @@ void lily_emit_write_for_of(lily_emit_state *emit, lily_var *for_source,
                 elem_sym->reg_spot, line_num);
 }
 
-/* This is called before 'continue', 'break', or 'return' is written. It writes
-   the appropriate number of try+catch pop instructions to offset the movement.
-   A search is done from the current block down to 'stop_block' to find out how
-   many try pop's to write. */
-static void write_pop_try_blocks_up_to(lily_emit_state *emit,
-        lily_block *stop_block)
-{
-    lily_block *block_iter = emit->block;
-    int try_count = 0;
-
-    while (block_iter != stop_block) {
-        if (block_iter->block_type == block_try &&
-            (block_iter->flags & BLOCK_HAS_BRANCH) == 0)
-            try_count++;
-
-        block_iter = block_iter->prev;
-    }
-
-    if (try_count) {
-        int i;
-        for (i = 0;i < try_count;i++)
-            lily_u16_write_1(emit->code, o_catch_pop);
-    }
-}
-
 static void write_loop_patch(lily_emit_state *emit, lily_block *block)
 {
     uint16_t patch = lily_u16_pos(emit->code) - 1;
@@ -312,8 +292,10 @@ static void write_loop_patch(lily_emit_state *emit, lily_block *block)
 
         /* The blocks after the one that got the new patch need to have their
            starts adjusted or they'll think it belongs to them. */
-        for (block = block->next; block; block = block->next)
+        for (block = block->next; block; block = block->next) {
             block->patch_start++;
+            block->dead_patch++;
+        }
     }
 }
 
@@ -325,7 +307,6 @@ int lily_emit_try_write_break(lily_emit_state *emit)
     if (block == NULL)
         return 0;
 
-    write_pop_try_blocks_up_to(emit, block);
     lily_u16_write_2(emit->code, o_jump, 1);
     write_loop_patch(emit, block);
     return 1;
@@ -339,8 +320,6 @@ int lily_emit_try_write_continue(lily_emit_state *emit)
     if (block == NULL)
         return 0;
 
-    write_pop_try_blocks_up_to(emit, block);
-
     if (block->block_type != block_do_while) {
         uint16_t where = block->code_start - lily_u16_pos(emit->code);
 
@@ -398,6 +377,39 @@ static void write_patches_since(lily_emit_state *emit, uint16_t start)
     lily_u16_set_pos(emit->patches, start);
 }
 
+/* Code from the block's dead_start can't be reached, because a condition before
+   it is constant. This removes that code, unless a jump from outside of it is
+   waiting to be patched into it (a 'break' for an outer loop, for example).
+   Returns 1 if the code was removed, 0 otherwise. */
+static int drop_dead_code(lily_emit_state *emit, lily_block *block)
+{
+    uint16_t start = block->dead_start;
+    uint16_t stop = lily_u16_pos(emit->patches);
+    uint16_t i;
+
+    for (i = 0;i < stop;i++) {
+        uint16_t patch = lily_u16_get(emit->patches, i);
+
+        /* Patches of 0 are placeholders that don't point anywhere. */
+        if (patch != 0 && (patch >= start) != (i >= block->dead_patch))
+            return 0;
+    }
+
+    lily_buffer_u16 *catch_table = emit->catch_table;
+    uint16_t catch_pos = lily_u16_pos(catch_table);
+
+    /* Try blocks in the dead code have entries at the end of the table. */
+    while (catch_pos > emit->scope_block->catch_start &&
+           lily_u16_get(catch_table, catch_pos - 3) >= start)
+        catch_pos -= 3;
+
+    lily_u16_set_pos(catch_table, catch_pos);
+    lily_u16_set_pos(emit->patches, block->dead_patch);
+    lily_u16_set_pos(emit->code, start);
+    block->last_exit = UINT16_MAX;
+    return 1;
+}
+
 /***
  *      ____  _
  *     / ___|| |_ ___  _ __ __ _  __ _  ___  ___
@@ -407,12 +419,17 @@ static void write_patches_since(lily_emit_state *emit, uint16_t start)
  *                               |___/
  */
 
+#define STORAGE_GROUP_EXACT 0
+#define STORAGE_GROUP_PLAIN 1
+#define STORAGE_GROUP_DEREF 2
+
 static lily_storage *new_storage(void)
 {
     lily_storage *result = lily_malloc(sizeof(*result));
 
     result->type = NULL;
     result->expr_num = 0;
+    result->group = STORAGE_GROUP_EXACT;
     result->flags = 0;
     result->item_kind = ITEM_STORAGE;
 
@@ -478,12 +495,35 @@ static void clear_storages(lily_storage_stack *stack, uint16_t count)
         stack->data[i]->type = NULL;
 }
 
+/* Storages only live for the expression that made them, so a storage from an
+   older expression can be given a new type if both are written the same way.
+   The plain group holds types that the vm writes to without a deref first.
+   Anything else is written through a deref, except for the unset placeholder
+   and value enums which keep their own type. */
+static uint32_t storage_group(lily_type *type)
+{
+    uint16_t cls_id = type->cls_id;
+
+    if (cls_id == LILY_ID_INTEGER ||
+        cls_id == LILY_ID_DOUBLE ||
+        cls_id == LILY_ID_BOOLEAN ||
+        cls_id == LILY_ID_BYTE)
+        return STORAGE_GROUP_PLAIN;
+
+    if (type == lily_unset_type ||
+        type->cls->flags & CLS_IS_HAS_VALUE)
+        return STORAGE_GROUP_EXACT;
+
+    return STORAGE_GROUP_DEREF;
+}
+
 /* This attempts to grab a storage of the given type. It will first attempt to
    get a used storage, then a new one. */
 static lily_storage *get_storage(lily_emit_state *emit, lily_type *type)
 {
     lily_storage_stack *stack = emit->storages;
     uint32_t expr_num = emit->expr_num;
+    uint32_t group = storage_group(type);
     uint16_t i;
     lily_storage *s = NULL;
 
@@ -493,6 +533,7 @@ static lily_storage *get_storage(lily_emit_state *emit, lily_type *type)
         /* A storage with a type of NULL is not in use and can be claimed. */
         if (s->type == NULL) {
             s->type = type;
+            s->group = group;
             s->flags = SYM_NOT_ASSIGNABLE;
 
             s->reg_spot = emit->scope_block->next_reg_spot;
@@ -506,8 +547,11 @@ static lily_storage *get_storage(lily_emit_state *emit, lily_type *type)
 
             break;
         }
-        else if (s->type == type &&
-                 s->expr_num != expr_num) {
+        else if (s->expr_num != expr_num &&
+                 (s->type == type ||
+                  (group != STORAGE_GROUP_EXACT &&
+                   s->group == group))) {
+            s->type = type;
             s->expr_num = expr_num;
             s->flags = SYM_NOT_ASSIGNABLE;
             break;
@@ -562,6 +606,7 @@ static void setup_scope_block(lily_emit_state *emit, lily_block *new_block)
     new_block->next_reg_spot = 0;
     new_block->storage_count = 0;
     new_block->code_start = lily_u16_pos(emit->code);
+    new_block->catch_start = lily_u16_pos(emit->catch_table);
 
     emit->storages->start += emit->scope_block->storage_count;
     emit->scope_block = new_block;
@@ -735,9 +780,10 @@ void lily_emit_enter_try_block(lily_emit_state *emit)
     block->block_type = block_try;
     emit->block = block;
 
-    /* Each branch of a try block contains a jump to the next branch. */
-    lily_u16_write_3(emit->code, o_catch_push, 1, *emit->lex_linenum);
-    lily_u16_write_1(emit->patches, lily_u16_pos(emit->code) - 2);
+    /* Nothing is written to enter a try block. When the first except is
+       reached, the range of the try block goes into the catch table.
+       Branch switching expects a patch, so write a fake one to skip over. */
+    lily_u16_write_1(emit->patches, 0);
 }
 
 void lily_emit_enter_while_block(lily_emit_state *emit)
@@ -774,11 +820,25 @@ void lily_emit_leave_block(lily_emit_state *emit)
     lily_block *block = emit->block;
     int block_type = block->block_type;
 
-    /* These blocks need to jump back up when the bottom is hit. */
+    /* These blocks need to jump back up when the bottom is hit. A while that
+       never runs is removed instead. */
     if (block_type == block_while ||
         block_type == block_for_in) {
-        int x = block->code_start - lily_u16_pos(emit->code);
-        lily_u16_write_2(emit->code, o_jump, (uint16_t)x);
+        if ((block->flags & BLOCK_DEAD_BRANCH) == 0 ||
+            drop_dead_code(emit, block) == 0) {
+            int x = block->code_start - lily_u16_pos(emit->code);
+            lily_u16_write_2(emit->code, o_jump, (uint16_t)x);
+        }
+    }
+    else if (block_type == block_if &&
+             block->flags & (BLOCK_DEAD_BRANCH | BLOCK_DEAD_REST)) {
+        int exits = (block->last_exit == lily_u16_pos(emit->code));
+
+        /* If every branch exits, then the always true branch before the dead
+           ones did too. */
+        if (drop_dead_code(emit, block) && exits &&
+            block->flags & BLOCK_DEAD_REST)
+            block->last_exit = lily_u16_pos(emit->code);
     }
     else if (block_type == block_match ||
              block_type == block_with)
@@ -804,6 +864,60 @@ void lily_emit_leave_block(lily_emit_state *emit)
     emit->block = emit->block->prev;
 }
 
+/* This moves the catch table entries of the current scope into the function
+   given. Entries hold positions in emitter's code, so 'code_start' is taken off
+   to make them relative to the function's code. */
+static void finish_catch_table(lily_emit_state *emit, lily_function_val *f,
+        uint16_t code_start)
+{
+    lily_proto *proto = f->proto;
+    uint16_t start = emit->scope_block->catch_start;
+    uint16_t stop = lily_u16_pos(emit->catch_table);
+    uint16_t i;
+
+    lily_free(proto->catch_table);
+    proto->catch_table = NULL;
+    f->has_catch = 0;
+
+    if (start == stop)
+        return;
+
+    uint16_t *table = lily_malloc((stop - start + 1) * sizeof(*table));
+
+    table[0] = stop - start + 1;
+
+    for (i = start;i < stop;i += 3) {
+        uint16_t *entry = table + i - start + 1;
+
+        entry[0] = lily_u16_get(emit->catch_table, i) - code_start;
+        entry[1] = lily_u16_get(emit->catch_table, i + 1) - code_start;
+        entry[2] = lily_u16_get(emit->catch_table, i + 2) - code_start;
+    }
+
+    proto->catch_table = table;
+    f->has_catch = 1;
+    lily_u16_set_pos(emit->catch_table, start);
+}
+
+static void optimize_block_code(lily_emit_state *emit, lily_function_val *f,
+        uint16_t *code, uint16_t *code_size)
+{
+    lily_block *block = emit->scope_block;
+    lily_storage_stack *stack = emit->storages;
+    uint16_t reg_count = block->next_reg_spot;
+    uint8_t *storages = lily_malloc((reg_count + 1) * sizeof(*storages));
+    uint16_t i, stop = stack->start + block->storage_count;
+
+    memset(storages, 0, reg_count + 1);
+
+    for (i = stack->start;i < stop;i++)
+        storages[stack->data[i]->reg_spot] = 1;
+
+    f->proto->optimize_count = lily_opt_function(code, code_size,
+            f->proto->catch_table, storages);
+    lily_free(storages);
+}
+
 static void finish_block_code(lily_emit_state *emit)
 {
     lily_block *block = emit->scope_block;
@@ -834,6 +948,10 @@ static void finish_block_code(lily_emit_state *emit)
     uint16_t *code = lily_malloc((code_size + 1) * sizeof(*code));
 
     memcpy(code, source + code_start, sizeof(*code) * code_size);
+    finish_catch_table(emit, f, code_start);
+
+    if (emit->parser->config->optimize)
+        optimize_block_code(emit, f, code, &code_size);
 
     f->code_len = code_size;
     f->code = code;
@@ -996,16 +1114,37 @@ static lily_block *find_deepest_loop(lily_emit_state *emit)
 void lily_emit_branch_switch(lily_emit_state *emit)
 {
     lily_block *block = emit->block;
+
+    if (block->flags & BLOCK_DEAD_BRANCH) {
+        block->flags &= ~BLOCK_DEAD_BRANCH;
+
+        if (block->last_exit != lily_u16_pos(emit->code))
+            block->flags &= ~BLOCK_ALWAYS_EXITS;
+
+        /* The branch (and the jump over it) is gone, so there's nothing to
+           patch or jump over. */
+        if (drop_dead_code(emit, block)) {
+            block->flags |= BLOCK_HAS_BRANCH;
+            return;
+        }
+    }
+
     uint16_t patch = lily_u16_pop(emit->patches);
 
+    if (block->flags & BLOCK_TRUE_BRANCH) {
+        /* Later branches can't run, and neither can the exit jump. */
+        block->flags &= ~BLOCK_TRUE_BRANCH;
+        block->flags |= BLOCK_DEAD_REST;
+        block->dead_start = lily_u16_pos(emit->code);
+        block->dead_patch = lily_u16_pos(emit->patches);
+    }
+
     /* The spot in code has an offset for the patch. */
     uint16_t adjust = lily_u16_get(emit->code, patch);
 
-    if (block->last_exit != lily_u16_pos(emit->code)) {
-        if ((block->flags & BLOCK_HAS_BRANCH) == 0 &&
-            block->block_type == block_try)
-            lily_u16_write_1(emit->code, o_catch_pop);
+    uint16_t try_end = lily_u16_pos(emit->code);
 
+    if (block->last_exit != lily_u16_pos(emit->code)) {
         /* Since the current branch isn't confirmed to exit, write an exit jump.
            This exit jump will persist until the block is done. */
         lily_u16_write_2(emit->code, o_jump, 1);
@@ -1013,6 +1152,12 @@ void lily_emit_branch_switch(lily_emit_state *emit)
         block->flags &= ~BLOCK_ALWAYS_EXITS;
     }
 
+    if ((block->flags & BLOCK_HAS_BRANCH) == 0 &&
+        block->block_type == block_try)
+        /* The body is done and the first except is next. */
+        lily_u16_write_3(emit->catch_table, block->code_start, try_end,
+                lily_u16_pos(emit->code));
+
     if (patch != 0) {
         lily_u16_set_at(emit->code, patch,
                 lily_u16_pos(emit->code) + adjust - patch);
@@ -1393,7 +1538,11 @@ static void free_proto_stack(lily_proto_stack *stack)
         lily_proto *p = stack->data[i];
         lily_free(p->name);
         lily_free(p->locals);
+        lily_free(p->catch_table);
         lily_free(p->code);
+#ifdef LILY_WITH_PROFILE
+        lily_free(p->profile_hits);
+#endif
 
         if (p->keywords) {
             lily_free(p->keywords[0]);
@@ -1455,8 +1604,15 @@ lily_proto *lily_emit_new_proto(lily_emit_state *emit, const char *module_path,
     p->module_path = module_path;
     p->name = proto_name;
     p->locals = NULL;
+    p->catch_table = NULL;
     p->code = NULL;
     p->keywords = NULL;
+    p->optimize_count = 0;
+#ifdef LILY_WITH_PROFILE
+    p->profile_hits = NULL;
+    p->profile_calls = 0;
+    p->profile_hits_len = 0;
+#endif
 
     protos->data[protos->pos] = p;
     protos->pos++;
@@ -1495,6 +1651,11 @@ static void check_valid_subscript(lily_emit_state *emit, lily_ast *var_ast,
     int var_cls_id = var_ast->result->type->cls_id;
     if (var_cls_id == LILY_ID_LIST || var_cls_id == LILY_ID_BYTESTRING ||
         var_cls_id == LILY_ID_STRING) {
+        /* Integer literals are always valid, and List subscripts by one are
+           not evaluated (see is_literal_index). */
+        if (index_ast->tree_type == tree_integer)
+            return;
+
         lily_type *index_type = index_ast->result->type;
 
         if ((index_type->flags & CLS_IS_BASIC_NUMBER) == 0)
@@ -1981,6 +2142,16 @@ static lily_type *get_solved_property_type(lily_emit_state *emit, lily_ast *ast)
     return property_type;
 }
 
+/* Exception capture doesn't build the traceback until it's read, so reads of
+   it use a different opcode. */
+static uint16_t property_get_op(lily_prop_entry *prop)
+{
+    if (prop->parent->id == LILY_ID_EXCEPTION && prop->id == 1)
+        return o_traceback_get;
+
+    return o_property_get;
+}
+
 /* This is called after eval_oo_access_for_item. It dumps the property or var
    to a storage. */
 static void oo_property_read(lily_emit_state *emit, lily_ast *ast)
@@ -1991,7 +2162,7 @@ static void oo_property_read(lily_emit_state *emit, lily_ast *ast)
 
     /* This function is only called on trees of type tree_oo_access which have
        a property into the ast's item. */
-    lily_u16_write_5(emit->code, o_property_get, prop->id,
+    lily_u16_write_5(emit->code, property_get_op(prop), prop->id,
             ast->arg_start->result->reg_spot, result->reg_spot, ast->line_num);
 
     /* Properties are assignable if their source is assignable. */
@@ -2280,10 +2451,313 @@ static void eval_arith_op(lily_emit_state *emit, lily_ast *ast)
     ast->result = (lily_sym *)s;
 }
 
+/* Constant folding. When every leaf of an arithmetic, compare, or unary tree
+   is a literal, the emitter computes the result and loads that instead. The
+   result must be exactly what the vm would have made. Anything that would
+   raise (division by zero) or that C leaves undefined (signed overflow, bad
+   shift counts) is left for the vm to do. */
+
+typedef struct {
+    uint16_t cls_id;
+    lily_raw_value value;
+} lily_fold_value;
+
+static int fold_tree(lily_emit_state *, lily_ast *, lily_fold_value *);
+
+static int fold_integer_op(lily_token op, int64_t left, int64_t right,
+        int64_t *result)
+{
+    switch (op) {
+        case tk_plus:
+            if ((right > 0 && left > INT64_MAX - right) ||
+                (right < 0 && left < INT64_MIN - right))
+                return 0;
+
+            *result = left + right;
+            break;
+        case tk_minus:
+            if ((right < 0 && left > INT64_MAX + right) ||
+                (right > 0 && left < INT64_MIN + right))
+                return 0;
+
+            *result = left - right;
+            break;
+        case tk_multiply:
+            if (left != 0 && right != 0) {
+                if (left > 0) {
+                    if ((right > 0 && left > INT64_MAX / right) ||
+                        (right < 0 && right < INT64_MIN / left))
+                        return 0;
+                }
+                else if ((right > 0 && left < INT64_MIN / right) ||
+                         (right < 0 && right < INT64_MAX / left))
+                    return 0;
+            }
+
+            *result = left * right;
+            break;
+        case tk_divide:
+        case tk_modulo:
+            if (right == 0 ||
+                (left == INT64_MIN && right == -1))
+                return 0;
+
+            if (op == tk_divide)
+                *result = left / right;
+            else
+                *result = left % right;
+
+            break;
+        case tk_left_shift:
+            if (right < 0 || right > 62 || left < 0 ||
+                left > (INT64_MAX >> right))
+                return 0;
+
+            *result = left << right;
+            break;
+        case tk_right_shift:
+            if (right < 0 || right > 63)
+                return 0;
+
+            *result = left >> right;
+            break;
+        case tk_bitwise_and:
+            *result = left & right;
+            break;
+        case tk_bitwise_or:
+            *result = left | right;
+            break;
+        case tk_bitwise_xor:
+            *result = left ^ right;
+            break;
+        default:
+            return 0;
+    }
+
+    return 1;
+}
+
+static int fold_double_op(lily_token op, double left, double right,
+        double *result)
+{
+    double d;
+
+    if (op == tk_plus)
+        d = left + right;
+    else if (op == tk_minus)
+        d = left - right;
+    else if (op == tk_multiply)
+        d = left * right;
+    else if (op == tk_divide && right != 0.0)
+        d = left / right;
+    else
+        return 0;
+
+    /* Literals are matched by value, so -0.0 would become 0.0. Leave that, as
+       well as infinity and nan, to the vm. */
+    if (d - d != 0.0 ||
+        (d == 0.0 && 1.0 / d < 0.0))
+        return 0;
+
+    *result = d;
+    return 1;
+}
+
+static int fold_compare_op(lily_token op, lily_fold_value *left,
+        lily_fold_value *right)
+{
+    int cmp;
+
+    if (left->cls_id == LILY_ID_DOUBLE || right->cls_id == LILY_ID_DOUBLE) {
+        double l = left->value.doubleval;
+        double r = right->value.doubleval;
+
+        if (left->cls_id == LILY_ID_INTEGER)
+            l = (double)left->value.integer;
+        else if (right->cls_id == LILY_ID_INTEGER)
+            r = (double)right->value.integer;
+
+        cmp = (l > r) - (l < r);
+    }
+    else if (left->cls_id == LILY_ID_STRING)
+        cmp = strcmp(left->value.string->string, right->value.string->string);
+    else {
+        int64_t l = left->value.integer;
+        int64_t r = right->value.integer;
+
+        cmp = (l > r) - (l < r);
+    }
+
+    switch (op) {
+        case tk_eq_eq:   return cmp == 0;
+        case tk_not_eq:  return cmp != 0;
+        case tk_lt:      return cmp < 0;
+        case tk_lt_eq:   return cmp <= 0;
+        case tk_gt:      return cmp > 0;
+        default:         return cmp >= 0;
+    }
+}
+
+static int fold_binary(lily_emit_state *emit, lily_ast *ast,
+        lily_fold_value *result)
+{
+    lily_fold_value left, right;
+    lily_token op = ast->op;
+    uint8_t prio = lily_priority_for_token(op);
+
+    /* Only arith (7 and up) and compare (4) ops can be folded. */
+    if ((prio != 4 && prio < 7) ||
+        fold_tree(emit, ast->left, &left) == 0 ||
+        fold_tree(emit, ast->right, &right) == 0)
+        return 0;
+
+    uint16_t left_id = left.cls_id;
+    uint16_t right_id = right.cls_id;
+    int mixed = (left_id == LILY_ID_INTEGER && right_id == LILY_ID_DOUBLE) ||
+                (left_id == LILY_ID_DOUBLE && right_id == LILY_ID_INTEGER);
+
+    if (left_id != right_id && mixed == 0)
+        return 0;
+
+    if (prio == 4) {
+        /* Only equality works on Boolean. */
+        if (left_id == LILY_ID_BOOLEAN &&
+            op != tk_eq_eq &&
+            op != tk_not_eq)
+            return 0;
+
+        result->cls_id = LILY_ID_BOOLEAN;
+        result->value.integer = fold_compare_op(op, &left, &right);
+        return 1;
+    }
+
+    if (left_id == LILY_ID_INTEGER && right_id == LILY_ID_INTEGER) {
+        result->cls_id = LILY_ID_INTEGER;
+        return fold_integer_op(op, left.value.integer, right.value.integer,
+                &result->value.integer);
+    }
+
+    if (left_id == LILY_ID_INTEGER)
+        left.value.doubleval = (double)left.value.integer;
+    else if (right_id == LILY_ID_INTEGER)
+        right.value.doubleval = (double)right.value.integer;
+    else if (left_id != LILY_ID_DOUBLE)
+        return 0;
+
+    result->cls_id = LILY_ID_DOUBLE;
+    return fold_double_op(op, left.value.doubleval, right.value.doubleval,
+            &result->value.doubleval);
+}
+
+static int fold_unary(lily_emit_state *emit, lily_ast *ast,
+        lily_fold_value *result)
+{
+    if (fold_tree(emit, ast->left, result) == 0)
+        return 0;
+
+    uint16_t id = result->cls_id;
+    int64_t i = result->value.integer;
+    lily_token op = ast->op;
+
+    if (op == tk_not &&
+        (id == LILY_ID_BOOLEAN || id == LILY_ID_INTEGER))
+        result->value.integer = !i;
+    else if (op == tk_tilde && id == LILY_ID_INTEGER)
+        result->value.integer = ~i;
+    else if (op == tk_minus && id == LILY_ID_INTEGER && i != INT64_MIN)
+        result->value.integer = -i;
+    else if (op == tk_minus && id == LILY_ID_DOUBLE &&
+             result->value.doubleval != 0.0)
+        result->value.doubleval = -result->value.doubleval;
+    else
+        return 0;
+
+    return 1;
+}
+
+/* Returns 1 if 'ast' is a constant, storing the value in 'result'. This does
+   not change the tree. */
+static int fold_tree(lily_emit_state *emit, lily_ast *ast,
+        lily_fold_value *result)
+{
+    switch (ast->tree_type) {
+        case tree_integer:
+            result->cls_id = LILY_ID_INTEGER;
+            result->value.integer = ast->backing_value;
+            return 1;
+        case tree_boolean:
+            result->cls_id = LILY_ID_BOOLEAN;
+            result->value.integer = ast->backing_value;
+            return 1;
+        case tree_literal: {
+            uint16_t id = ast->type->cls_id;
+
+            if (id != LILY_ID_INTEGER &&
+                id != LILY_ID_DOUBLE &&
+                id != LILY_ID_STRING)
+                return 0;
+
+            result->cls_id = id;
+            result->value = lily_literal_at(emit->symtab,
+                    ast->literal_reg_spot)->value;
+            return 1;
+        }
+        case tree_parenth:
+            return fold_tree(emit, ast->arg_start, result);
+        case tree_binary:
+            return fold_binary(emit, ast, result);
+        case tree_unary:
+            return fold_unary(emit, ast, result);
+        default:
+            return 0;
+    }
+}
+
+/* Load a folded value into a storage, and make that the result of 'ast'. */
+static void emit_fold_value(lily_emit_state *emit, lily_ast *ast,
+        lily_fold_value *v)
+{
+    lily_symtab *symtab = emit->symtab;
+    lily_literal *lit = NULL;
+    lily_type *type;
+    uint16_t opcode, spot;
+
+    if (v->cls_id == LILY_ID_BOOLEAN) {
+        type = symtab->boolean_class->self_type;
+        opcode = o_load_boolean;
+        spot = (uint16_t)v->value.integer;
+    }
+    else if (v->cls_id == LILY_ID_INTEGER &&
+             v->value.integer >= INT16_MIN &&
+             v->value.integer <= INT16_MAX) {
+        type = symtab->integer_class->self_type;
+        opcode = o_load_integer;
+        spot = (uint16_t)(int16_t)v->value.integer;
+    }
+    else {
+        if (v->cls_id == LILY_ID_INTEGER)
+            lit = lily_get_integer_literal(symtab, &type, v->value.integer);
+        else if (v->cls_id == LILY_ID_DOUBLE)
+            lit = lily_get_double_literal(symtab, &type, v->value.doubleval);
+        else
+            lit = lily_get_string_literal(symtab, &type,
+                    v->value.string->string);
+
+        opcode = o_load_readonly;
+        spot = lit->reg_spot;
+    }
+
+    lily_storage *s = get_storage(emit, type);
+
+    lily_u16_write_4(emit->code, opcode, spot, s->reg_spot, ast->line_num);
+    ast->result = (lily_sym *)s;
+}
+
 static void eval_binary_op(lily_emit_state *emit, lily_ast *ast,
         lily_type *expect)
 {
     uint8_t prio = lily_priority_for_token(ast->op);
+    lily_fold_value v;
 
     /* See `scripts/token.lily` for priority groups. */
 
@@ -2296,7 +2770,10 @@ static void eval_binary_op(lily_emit_state *emit, lily_ast *ast,
             eval_logical_op(emit, ast);
             break;
         case 4:
-            eval_compare_op(emit, ast);
+            if (fold_tree(emit, ast, &v))
+                emit_fold_value(emit, ast, &v);
+            else
+                eval_compare_op(emit, ast);
             break;
         case 5:
             eval_plus_plus(emit, ast);
@@ -2305,6 +2782,11 @@ static void eval_binary_op(lily_emit_state *emit, lily_ast *ast,
             eval_func_pipe(emit, ast, expect);
             break;
         default:
+            if (fold_tree(emit, ast, &v)) {
+                emit_fold_value(emit, ast, &v);
+                break;
+            }
+
             if (ast->left->tree_type != tree_local_var)
                 eval_tree(emit, ast->left, lily_question_type);
 
@@ -2521,6 +3003,52 @@ static void eval_assign_upvalue(lily_emit_state *emit, lily_ast *ast)
     ast->result = right_sym;
 }
 
+/* Tuple subscripts are an Integer literal that check_valid_subscript verifies
+   is in range. They're written as property access. A List subscript by an
+   Integer literal has an opcode that takes the index from the code. Either way,
+   the index doesn't need to be loaded into a register. */
+static int is_literal_index(lily_ast *var_ast, lily_ast *index_ast)
+{
+    uint16_t cls_id = var_ast->result->type->cls_id;
+
+    return (cls_id == LILY_ID_TUPLE || cls_id == LILY_ID_LIST) &&
+           index_ast->tree_type == tree_integer;
+}
+
+static void write_subscript(lily_emit_state *emit, lily_ast *var_ast,
+        lily_ast *index_ast, lily_sym *sym, int is_set, uint16_t line_num)
+{
+    lily_sym *var_sym = var_ast->result;
+    uint16_t opcode;
+
+    if (is_literal_index(var_ast, index_ast)) {
+        if (var_sym->type->cls_id == LILY_ID_TUPLE)
+            opcode = is_set ? o_property_set : o_property_get;
+        else
+            opcode = is_set ? o_list_set_literal : o_list_get_literal;
+
+        lily_u16_write_5(emit->code, opcode, (uint16_t)index_ast->backing_value,
+                var_sym->reg_spot, sym->reg_spot, line_num);
+        return;
+    }
+
+    switch (var_sym->type->cls_id) {
+        case LILY_ID_LIST:
+            opcode = is_set ? o_list_set : o_list_get;
+            break;
+        case LILY_ID_HASH:
+            opcode = is_set ? o_hash_set : o_hash_get;
+            break;
+        default:
+            /* String and ByteString share a representation. */
+            opcode = is_set ? o_bytestring_set : o_bytestring_get;
+            break;
+    }
+
+    lily_u16_write_5(emit->code, opcode, var_sym->reg_spot,
+            index_ast->result->reg_spot, sym->reg_spot, line_num);
+}
+
 /* Evaluate `x[y] = z` or `x[y] += z`. The left side of this is a subscript,
    wherein the first tree is the subject, and the second is the index. This is
    the most complex of the assignments. */
@@ -2540,7 +3068,8 @@ static void eval_assign_sub(lily_emit_state *emit, lily_ast *ast)
     /* The index is usually a literal or a var and therefore has no need for
        inference. Since fetching inference would be a little annoying and
        unlikely to be useful, don't bother sending any. */
-    if (index_ast->tree_type != tree_local_var)
+    if (index_ast->tree_type != tree_local_var &&
+        is_literal_index(var_ast, index_ast) == 0)
         eval_tree(emit, index_ast, lily_question_type);
 
     lily_type *var_type = var_ast->result->type;
@@ -2569,14 +3098,13 @@ static void eval_assign_sub(lily_emit_state *emit, lily_ast *ast)
            inline it here. */
         lily_storage *s = get_storage(emit, elem_type);
 
-        lily_u16_write_5(emit->code, o_subscript_get, var_ast->result->reg_spot,
-                index_ast->result->reg_spot, s->reg_spot, ast->line_num);
+        write_subscript(emit, var_ast, index_ast, (lily_sym *)s, 0,
+                ast->line_num);
         ast->left->result = (lily_sym *)s;
         right_sym = eval_assign_spoof_op(emit, ast);
     }
 
-    lily_u16_write_5(emit->code, o_subscript_set, var_ast->result->reg_spot,
-            index_ast->result->reg_spot, right_sym->reg_spot, ast->line_num);
+    write_subscript(emit, var_ast, index_ast, right_sym, 1, ast->line_num);
     ast->result = right_sym;
 }
 
@@ -2621,8 +3149,8 @@ static void eval_property(lily_emit_state *emit, lily_ast *ast,
 
     lily_storage *result = get_storage(emit, ast->property->type);
 
-    lily_u16_write_5(emit->code, o_property_get, ast->property->id,
-            emit->scope_block->self->reg_spot,
+    lily_u16_write_5(emit->code, property_get_op(ast->property),
+            ast->property->id, emit->scope_block->self->reg_spot,
             result->reg_spot, ast->line_num);
 
     result->flags &= ~SYM_NOT_ASSIGNABLE;
@@ -2735,6 +3263,43 @@ static void eval_logical_op(lily_emit_state *emit, lily_ast *ast)
     }
 }
 
+/* A String literal key for a Hash is hashed here, instead of each time that the
+   vm looks it up. */
+static int is_literal_hash_key(lily_ast *var_ast, lily_ast *index_ast)
+{
+    lily_type *var_type = var_ast->result->type;
+
+    return var_type->cls_id == LILY_ID_HASH &&
+           index_ast->tree_type == tree_literal &&
+           index_ast->type->cls_id == LILY_ID_STRING &&
+           var_type->subtypes[0] == index_ast->type;
+}
+
+static void eval_literal_hash_key(lily_emit_state *emit, lily_ast *ast,
+        lily_type *expect)
+{
+    lily_ast *var_ast = ast->arg_start;
+    lily_ast *index_ast = var_ast->next_arg;
+    uint16_t key_spot = index_ast->literal_reg_spot;
+    lily_string_val *key = lily_literal_at(emit->symtab, key_spot)->value.string;
+    uint64_t hash = lily_hash_for_string(emit->parser->config->sipkey, key);
+    lily_storage *result = get_storage(emit,
+            var_ast->result->type->subtypes[1]);
+
+    if ((var_ast->result->flags & SYM_NOT_ASSIGNABLE) == 0)
+        result->flags &= ~SYM_NOT_ASSIGNABLE;
+
+    lily_u16_write_5(emit->code, o_hash_get_literal, key_spot,
+            (uint16_t)hash, (uint16_t)(hash >> 16), (uint16_t)(hash >> 32));
+    lily_u16_write_4(emit->code, (uint16_t)(hash >> 48),
+            var_ast->result->reg_spot, result->reg_spot, ast->line_num);
+
+    ast->result = (lily_sym *)result;
+
+    if (result->type != expect)
+        maybe_promote_value(emit, ast, expect);
+}
+
 /* This runs a subscript, including validation of the indexes. */
 static void eval_subscript(lily_emit_state *emit, lily_ast *ast,
         lily_type *expect)
@@ -2744,7 +3309,13 @@ static void eval_subscript(lily_emit_state *emit, lily_ast *ast,
     if (var_ast->tree_type != tree_local_var)
         eval_tree(emit, var_ast, lily_question_type);
 
-    if (index_ast->tree_type != tree_local_var)
+    if (is_literal_hash_key(var_ast, index_ast)) {
+        eval_literal_hash_key(emit, ast, expect);
+        return;
+    }
+
+    if (index_ast->tree_type != tree_local_var &&
+        is_literal_index(var_ast, index_ast) == 0)
         eval_tree(emit, index_ast, lily_question_type);
 
     check_valid_subscript(emit, var_ast, index_ast);
@@ -2759,8 +3330,8 @@ static void eval_subscript(lily_emit_state *emit, lily_ast *ast,
     if ((var_ast->result->flags & SYM_NOT_ASSIGNABLE) == 0)
         result->flags &= ~SYM_NOT_ASSIGNABLE;
 
-    lily_u16_write_5(emit->code, o_subscript_get, var_ast->result->reg_spot,
-            index_ast->result->reg_spot, result->reg_spot, ast->line_num);
+    write_subscript(emit, var_ast, index_ast, (lily_sym *)result, 0,
+            ast->line_num);
 
     ast->result = (lily_sym *)result;
 
@@ -2785,6 +3356,13 @@ static void eval_typecast(lily_emit_state *emit, lily_ast *ast)
 
 static void eval_unary_op(lily_emit_state *emit, lily_ast *ast)
 {
+    lily_fold_value v;
+
+    if (fold_tree(emit, ast, &v)) {
+        emit_fold_value(emit, ast, &v);
+        return;
+    }
+
     /* Inference shouldn't be necessary for something so simple. */
     if (ast->left->tree_type != tree_local_var)
         eval_tree(emit, ast->left, lily_question_type);
@@ -3875,9 +4453,8 @@ static void init_call_state(lily_emit_state *emit, lily_ast *ast,
                     first_arg->result = s;
                     first_arg->tree_type = tree_cached;
                 }
-                else
-                    /* Unpack the virt. Call start will route it. */
-                    oo_virt_read(emit, first_arg);
+                /* Virtual methods are found when the call is made, so
+                   there's nothing to unpack. Call start will route it. */
             }
 
             call_item = first_arg->item;
@@ -3905,7 +4482,6 @@ static void init_call_state(lily_emit_state *emit, lily_ast *ast,
             call_item = first_arg->item;
             break;
         case tree_method_virt:
-            eval_method_virt(emit, first_arg);
             call_item = first_arg->item;
             break;
         default:
@@ -3967,23 +4543,27 @@ static lily_type *start_call(lily_emit_state *emit, lily_ast *ast)
             break;
         case ITEM_VIRTUAL_METHOD:
         case ITEM_FORWARD_VIRT:
-            /* The call will use the unpacked virt. Similar to above. */
             ast->sym = first_arg->sym;
-            call_source_reg = first_arg->result->reg_spot;
             call_type = ast->sym->type;
 
             if (first_arg->tree_type == tree_oo_access) {
-                /* For `x.y` calls, send `x` for self. */
+                /* For `x.y` calls, send `x` for self. The vm finds the
+                   method in the vtable of self when the call is made. */
+                call_op = o_call_virt;
+                call_source_reg = ((lily_var *)ast->sym)->virt_spot;
                 first_arg->result = first_arg->arg_start->result;
                 first_arg->tree_type = tree_cached;
             }
             else if (first_arg->tree_type == tree_method_virt) {
                 /* For known methods, send scope self as self. */
+                call_op = o_call_virt;
+                call_source_reg = ((lily_var *)ast->sym)->virt_spot;
                 first_arg->result = (lily_sym *)emit->scope_block->self;
                 first_arg->tree_type = tree_cached;
             }
-            else if (first_arg->tree_type == tree_static_func) {
+            else {
                 /* `Someclass.f` has no self or register source. */
+                call_source_reg = first_arg->result->reg_spot;
 
                 if ((ast->sym->flags & VAR_IS_FOREIGN_FUNC) == 0)
                     call_op = o_call_native;
@@ -4474,8 +5054,61 @@ static void eval_func_pipe(lily_emit_state *emit, lily_ast *ast,
     eval_call(emit, ast, expect);
 }
 
+static int fold_plus_plus_part(lily_emit_state *emit, lily_ast *ast,
+        lily_msgbuf *msgbuf)
+{
+    lily_fold_value v;
+
+    if (fold_tree(emit, ast, &v) == 0)
+        return 0;
+
+    if (v.cls_id == LILY_ID_STRING)
+        lily_mb_add(msgbuf, v.value.string->string);
+    else if (v.cls_id == LILY_ID_INTEGER)
+        lily_mb_add_fmt(msgbuf, "%ld", v.value.integer);
+    else
+        return 0;
+
+    return 1;
+}
+
+/* Returns 1 if every part of the `++` chain ending at 'ast' is a constant
+   String or Integer. If so, 'msgbuf' holds the joined result. */
+static int fold_plus_plus(lily_emit_state *emit, lily_ast *ast,
+        lily_msgbuf *msgbuf)
+{
+    lily_ast *left = ast->left;
+    int ok;
+
+    if (left->tree_type == tree_binary &&
+        left->op == tk_plus_plus)
+        ok = fold_plus_plus(emit, left, msgbuf);
+    else
+        ok = fold_plus_plus_part(emit, left, msgbuf);
+
+    return ok && fold_plus_plus_part(emit, ast->right, msgbuf);
+}
+
 static void eval_plus_plus(lily_emit_state *emit, lily_ast *ast)
 {
+    if (ast->parent == NULL ||
+        (ast->parent->tree_type != tree_binary ||
+         ast->parent->op != tk_plus_plus)) {
+        lily_msgbuf *msgbuf = lily_mb_flush(emit->raiser->aux_msgbuf);
+
+        if (fold_plus_plus(emit, ast, msgbuf)) {
+            lily_type *t;
+            lily_literal *lit = lily_get_string_literal(emit->symtab, &t,
+                    lily_mb_raw(msgbuf));
+            lily_storage *s = get_storage(emit, t);
+
+            lily_u16_write_4(emit->code, o_load_readonly, lit->reg_spot,
+                    s->reg_spot, ast->line_num);
+            ast->result = (lily_sym *)s;
+            return;
+        }
+    }
+
     if (ast->left->tree_type != tree_local_var)
         eval_tree(emit, ast->left, lily_question_type);
 
@@ -4757,6 +5390,28 @@ static int is_compare_tree(lily_ast *ast)
     return result;
 }
 
+/* The condition of the current branch is constant. The code that can't run
+   because of it is removed when the branch or block is done. */
+static void mark_constant_branch(lily_emit_state *emit, int is_true)
+{
+    lily_block *block = emit->block;
+
+    /* This branch is after an always true one, so it's already dead. */
+    if (block->flags & BLOCK_DEAD_REST)
+        return;
+
+    if (is_true) {
+        /* There's nothing after a while's condition to remove. */
+        if (block->block_type == block_if)
+            block->flags |= BLOCK_TRUE_BRANCH;
+    }
+    else {
+        block->flags |= BLOCK_DEAD_BRANCH;
+        block->dead_start = lily_u16_pos(emit->code);
+        block->dead_patch = lily_u16_pos(emit->patches);
+    }
+}
+
 /* Evaluate an expression that falls through if truthy, or jumps to the next
    branch if falsey. */
 void lily_eval_entry_condition(lily_emit_state *emit, lily_expr_state *es)
@@ -4765,10 +5420,29 @@ void lily_eval_entry_condition(lily_emit_state *emit, lily_expr_state *es)
 
     if (is_false_tree(ast)) {
         /* Write a fake jump for block transition to skip over. */
+        mark_constant_branch(emit, 1);
         lily_u16_write_1(emit->patches, 0);
         return;
     }
 
+    lily_fold_value v;
+
+    if (fold_tree(emit, ast, &v) &&
+        (v.cls_id == LILY_ID_BOOLEAN || v.cls_id == LILY_ID_INTEGER)) {
+        mark_constant_branch(emit, v.value.integer != 0);
+
+        if (v.value.integer)
+            /* Always true, so there's nothing to test. */
+            lily_u16_write_1(emit->patches, 0);
+        else {
+            /* Always false, so skip straight to the next branch. */
+            lily_u16_write_2(emit->code, o_jump, 1);
+            lily_u16_write_1(emit->patches, lily_u16_pos(emit->code) - 1);
+        }
+
+        return;
+    }
+
     if (is_compare_tree(ast)) {
         /* Do exactly the start of eval_compare_op. */
         write_compare_or_error(emit, ast, eval_for_compare(emit, ast));
@@ -4923,7 +5597,6 @@ void lily_eval_return(lily_emit_state *emit, lily_expr_state *es,
                 "return expected type '^T' but got type '^T'.", return_type,
                 ast->result->type);
 
-    write_pop_try_blocks_up_to(emit, emit->scope_block);
     lily_u16_write_3(emit->code, o_return_value, ast->result->reg_spot,
             ast->line_num);
     emit->block->last_exit = lily_u16_pos(emit->code);
@@ -4950,7 +5623,6 @@ void lily_eval_raise(lily_emit_state *emit, lily_expr_state *es)
 
 void lily_eval_unit_return(lily_emit_state *emit)
 {
-    write_pop_try_blocks_up_to(emit, emit->scope_block);
     lily_u16_write_2(emit->code, o_return_unit, *emit->lex_linenum);
     emit->block->last_exit = lily_u16_pos(emit->code);
 }
@@ -4966,6 +5638,16 @@ void lily_prepare_main(lily_emit_state *emit, lily_function_val *main_func)
     main_func->code = emit->code->data;
     main_func->proto->code = main_func->code;
     main_func->reg_count = register_count;
+    finish_catch_table(emit, main_func, 0);
+
+#ifdef LILY_WITH_PROFILE
+    /* This pass writes over the old code, so the old counts are useless. */
+    lily_proto *main_proto = main_func->proto;
+
+    lily_free(main_proto->profile_hits);
+    main_proto->profile_hits = NULL;
+    main_proto->profile_hits_len = 0;
+#endif
 
     /* Emitter won't write code until the next pass comes around. Set it up so
        that it will start writing over the old instructions with new ones. */
@@ -71,6 +71,15 @@ typedef enum {
 /* Definitions are allowed inside of this block. */
 # define BLOCK_ALLOW_DEFINE    0x400
 
+/* The condition of the current branch is always false (see dead_start). */
+# define BLOCK_DEAD_BRANCH    0x800
+
+/* The condition of the current branch is always true. */
+# define BLOCK_TRUE_BRANCH    0x1000
+
+/* A branch before this one is always true, so no branch after it can run. */
+# define BLOCK_DEAD_REST      0x2000
+
 /* Storages are used to hold values not held by vars. In most cases, storages
    hold intermediate values for an expression. The emitter attempts to reuse
    storages where it can unless the storage is locked.
@@ -94,7 +103,9 @@ typedef struct lily_storage_ {
     /* Each expression has a different id to prevent emitter from wrongly using
        the same storage again. */
     uint32_t expr_num;
-    uint32_t pad3;
+    /* The group of the type when it was set (see get_storage). This is kept
+       because a rewind can free the type. */
+    uint32_t group;
 } lily_storage;
 
 /* For simplicity, classes, conditions, definitions, modules, and so on are all
@@ -129,6 +140,8 @@ typedef struct lily_block_ {
     /* Non-scope blocks: These are places that need to be fixed when a future
        jump location is known. */
     uint16_t patch_start;
+    /* Scope blocks: Where this block's entries in the catch table start. */
+    uint16_t catch_start;
     /* Match blocks: Where this block starts in emitter's match cases. */
     uint16_t match_case_start;
 
@@ -143,6 +156,12 @@ typedef struct lily_block_ {
     /* Define block: Where to restore generics when this block closes. */
     uint16_t generic_start;
 
+    /* If and while blocks: Where code that can't be reached starts. It's
+       removed when the branch (or the rest of the block) is done. */
+    uint16_t dead_start;
+    /* If and while blocks: Where the patches of that code start. */
+    uint16_t dead_patch;
+
     union {
         /* Scope blocks: The var that will receive the code when this scope is
            done. This is NULL for enum blocks which is okay because they don't
@@ -191,6 +210,11 @@ typedef struct {
        across in here to prevent duplicates. */
     lily_buffer_u16 *match_cases;
 
+    /* Try blocks write their start, end, and first except here when their
+       first except is reached. When a function is done, the entries after its
+       block's catch_start are moved into its proto. */
+    lily_buffer_u16 *catch_table;
+
     /* All code is written initially to here. When a function is done, a block
        of the appropriate size is copied from here into the function value. */
     lily_buffer_u16 *code;
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <string.h>
 
 #include "lily.h"
@@ -11,6 +12,9 @@
 #ifdef _WIN32
 /* Need this to process system directories. */
 # include <windows.h>
+#else
+# include <dirent.h>
+# include <errno.h>
 #endif
 
 /** The import system (ims) handles building modules and dispatching imports to
@@ -54,6 +58,8 @@ lily_import_state *lily_new_import_state(void)
     ims->module_top = NULL;
     ims->next_module_id = 0;
     ims->path_msgbuf = lily_new_msgbuf(64);
+    ims->dir_cache = NULL;
+    ims->dir_msgbuf = lily_new_msgbuf(64);
     ims->prelude = NULL;
     ims->sys_dirs = NULL;
 
@@ -92,6 +98,8 @@ void lily_free_import_state(lily_import_state *ims)
         module_iter = module_next;
     }
 
+    lily_ims_clear_dir_cache(ims);
+    lily_free_msgbuf(ims->dir_msgbuf);
     lily_free_msgbuf(ims->path_msgbuf);
     lily_free(ims->sys_dirs);
     lily_free(ims);
@@ -188,6 +196,219 @@ static void add_fixslash_dir(lily_msgbuf *msgbuf, const char *input_str)
 }
 
 
+/* Directory cache. */
+
+
+/* The default hook tries a file and a library in the local directory, the
+   package directory, then each system directory. Most of those probes fail,
+   and each failure is an fopen or dlopen. Instead, each directory that is
+   probed is scanned once and the names inside are saved. A probe only touches
+   the filesystem if the cache says the path might exist.
+
+   The cache can only ever say that a path definitely does not exist. Names are
+   compared without case because some filesystems ignore it, and a false match
+   only costs the probe that would have been done anyway. A directory that
+   exists but can't be listed says nothing, so paths in it are probed.
+
+   Package imports look in `packages/<name>/src`. A directory under a package
+   root is only opened if the package root lists `<name>`, so each missing
+   package costs nothing past the first. Other parents are never read.
+
+   The cache is cleared when new content is loaded, so files created between
+   parses are seen. */
+
+static int dir_has_entry(const char *entries, const char *name, size_t len)
+{
+    const char *iter = entries;
+
+    while (*iter) {
+        size_t entry_len = strlen(iter);
+
+        if (entry_len == len) {
+            size_t i;
+
+            for (i = 0;i < len;i++) {
+                if (tolower((unsigned char)iter[i]) !=
+                    tolower((unsigned char)name[i]))
+                    break;
+            }
+
+            if (i == len)
+                return 1;
+        }
+
+        iter += entry_len + 1;
+    }
+
+    return 0;
+}
+
+/* Returns the entries of the directory at 'path', or NULL if it can't be
+   opened. If that's because it isn't there, 'is_missing' is set to 1. */
+static char *read_dir_entries(lily_import_state *ims, const char *path,
+        uint32_t *is_missing)
+{
+    lily_msgbuf *msgbuf = lily_mb_flush(ims->dir_msgbuf);
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    const char *pattern = lily_mb_sprintf(msgbuf, "%s\\*", path);
+    HANDLE cursor = FindFirstFileA(pattern, &fd);
+
+    if (cursor == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+
+        *is_missing = (error == ERROR_PATH_NOT_FOUND ||
+                       error == ERROR_DIRECTORY);
+        return NULL;
+    }
+
+    lily_mb_flush(msgbuf);
+
+    do {
+        lily_mb_add(msgbuf, fd.cFileName);
+        lily_mb_add_char(msgbuf, '\0');
+    } while (FindNextFileA(cursor, &fd));
+
+    FindClose(cursor);
+#else
+    DIR *cursor = opendir(path);
+
+    if (cursor == NULL) {
+        *is_missing = (errno == ENOENT || errno == ENOTDIR);
+        return NULL;
+    }
+
+    while (1) {
+        struct dirent *e = readdir(cursor);
+
+        if (e == NULL)
+            break;
+
+        lily_mb_add(msgbuf, e->d_name);
+        lily_mb_add_char(msgbuf, '\0');
+    }
+
+    closedir(cursor);
+#endif
+
+    /* The message is always \0 terminated, so this ends with a double \0. */
+    uint32_t size = lily_mb_pos(msgbuf);
+    char *entries = lily_malloc((size + 1) * sizeof(*entries));
+
+    memcpy(entries, lily_mb_raw(msgbuf), size + 1);
+    return entries;
+}
+
+static lily_import_dir *get_dir(lily_import_state *, const char *, size_t);
+
+/* Is the first 'len' bytes of 'path' inside a package that the package root
+   above it doesn't have? */
+static int package_is_missing(lily_import_state *ims, const char *path,
+        size_t len)
+{
+    const char *root_name = "packages";
+    size_t root_len = strlen(root_name);
+    size_t end = len;
+
+    while (end) {
+        size_t start = end;
+
+        while (start && path[start - 1] != LILY_PATH_CHAR)
+            start--;
+
+        if (end != len &&
+            end - start == root_len &&
+            strncmp(path + start, root_name, root_len) == 0) {
+            const char *name = path + end + 1;
+            size_t name_len = 0;
+
+            while (end + 1 + name_len < len &&
+                   name[name_len] != LILY_PATH_CHAR)
+                name_len++;
+
+            if (name_len == 0)
+                return 0;
+
+            lily_import_dir *root = get_dir(ims, path, end);
+
+            if (root->entries == NULL)
+                return root->is_missing;
+
+            return dir_has_entry(root->entries, name, name_len) == 0;
+        }
+
+        if (start == 0)
+            break;
+
+        end = start - 1;
+    }
+
+    return 0;
+}
+
+static lily_import_dir *get_dir(lily_import_state *ims, const char *path,
+        size_t len)
+{
+    lily_import_dir *dir_iter = ims->dir_cache;
+
+    while (dir_iter) {
+        if (strncmp(dir_iter->path, path, len) == 0 &&
+            dir_iter->path[len] == '\0')
+            return dir_iter;
+
+        dir_iter = dir_iter->next;
+    }
+
+    lily_import_dir *dir = lily_malloc(sizeof(*dir));
+
+    dir->path = lily_malloc((len + 1) * sizeof(*dir->path));
+    strncpy(dir->path, path, len);
+    dir->path[len] = '\0';
+    dir->entries = NULL;
+    dir->is_missing = (uint32_t)package_is_missing(ims, path, len);
+
+    if (dir->is_missing == 0)
+        dir->entries = read_dir_entries(ims, dir->path, &dir->is_missing);
+
+    dir->next = ims->dir_cache;
+    ims->dir_cache = dir;
+    return dir;
+}
+
+static int path_is_missing(lily_import_state *ims, const char *path)
+{
+    const char *slash = strrchr(path, LILY_PATH_CHAR);
+
+    if (slash == NULL || slash == path)
+        return 0;
+
+    lily_import_dir *dir = get_dir(ims, path, slash - path);
+    const char *name = slash + 1;
+
+    if (dir->entries == NULL)
+        return (int)dir->is_missing;
+
+    return dir_has_entry(dir->entries, name, strlen(name)) == 0;
+}
+
+void lily_ims_clear_dir_cache(lily_import_state *ims)
+{
+    lily_import_dir *dir_iter = ims->dir_cache;
+
+    while (dir_iter) {
+        lily_import_dir *dir_next = dir_iter->next;
+
+        lily_free(dir_iter->path);
+        lily_free(dir_iter->entries);
+        lily_free(dir_iter);
+        dir_iter = dir_next;
+    }
+
+    ims->dir_cache = NULL;
+}
+
+
 /* Functions used by parser and here, or just parser. */
 
 
@@ -520,7 +741,10 @@ int lily_import_file(lily_state *s, const char *name)
     if (import_check(parser->ims, path))
         return path != NULL;
 
-    FILE *source = fopen(path, "r");
+    FILE *source = NULL;
+
+    if (path_is_missing(parser->ims, path) == 0)
+        source = fopen(path, "r");
 
     if (source == NULL) {
         lily_pa_add_data_string(parser, path);
@@ -582,7 +806,10 @@ int lily_import_library(lily_state *s, const char *name)
             break;
         }
 
-        void *handle = lily_library_load(path);
+        void *handle = NULL;
+
+        if (path_is_missing(parser->ims, path) == 0)
+            handle = lily_library_load(path);
 
         if (handle == NULL) {
             lily_pa_add_data_string(parser, path);
@@ -623,7 +850,21 @@ int lily_import_library_data(lily_state *s, const char *path,
     if (import_check(parser->ims, path))
         return 1;
 
-    lily_module *module = new_module(parser->ims);
+    /* A library can link to a predefined module (such as io linking to
+       coroutine) by giving that module's tables. Use the module that already
+       has them, so that class ids stay the same between both. */
+    lily_module *module = parser->ims->prelude->next;
+
+    while (module) {
+        if (module->info_table == info_table) {
+            parser->ims->last_import = module;
+            return 1;
+        }
+
+        module = module->next;
+    }
+
+    module = new_module(parser->ims);
 
     add_path_to_module(module, parser->ims->pending_loadname, path);
     add_data_to_module(module, NULL, info_table, call_table);
@@ -13,6 +13,24 @@ typedef enum {
     imp_system
 } lily_import_type;
 
+/* Import hooks usually probe several directories for each target. The import
+   state scans a directory at most once per parse cycle and keeps the names it
+   found, so that probes of paths that can't exist skip the filesystem. */
+typedef struct lily_import_dir_ {
+    char *path;
+
+    /* Entry names, each \0 terminated, with an extra \0 after the last one.
+       This is NULL if the directory could not be opened. */
+    char *entries;
+
+    /* 1 if the directory is known to not exist, 0 otherwise. If this is 0 and
+       there are no entries, the directory couldn't be read (ex: no read
+       permission), so probes go to the filesystem. */
+    uint32_t is_missing;
+
+    struct lily_import_dir_ *next;
+} lily_import_dir;
+
 /* The import state (ims) is where all modules are created and held. It also
    holds data relevant to the interpreter's import hook, which handles module
    discovery. This state does not have a rewind, because relevant fields are set
@@ -45,6 +63,12 @@ typedef struct lily_import_state_ {
        target. */
     const char *dirname;
 
+    /* Directories scanned during this parse cycle. */
+    lily_import_dir *dir_cache;
+
+    /* Scratch buffer for collecting directory entries. */
+    lily_msgbuf *dir_msgbuf;
+
     /* System directories are stored here with \0 between each one. The last
        entry is denoted by LILY_PATH_CHAR. */
     char *sys_dirs;
@@ -65,6 +89,7 @@ void lily_free_import_state(lily_import_state *);
 void lily_default_import_func(lily_state *, const char *);
 const char *lily_ims_build_path(lily_import_state *, const char *,
         const char *);
+void lily_ims_clear_dir_cache(lily_import_state *);
 lily_module *lily_ims_create_main(lily_import_state *);
 char *lily_ims_dir_from_path(const char *);
 void lily_ims_link_module_to(lily_module *, lily_module *, const char *);
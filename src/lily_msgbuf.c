@@ -10,7 +10,7 @@
 #include "lily_value.h"
 #include "lily_vm.h"
 
-extern lily_type *lily_unit_type;
+extern lily_type *const lily_unit_type;
 
 /* The internals of msgbuf are very simple. Unlike most declarations, this one
    is intentionally not within a .h file. The reasoning behind that, is that
@@ -484,7 +484,7 @@ static void add_list_like(lily_vm_state *vm, lily_msgbuf *msgbuf, tag *t,
         lily_value *v, const char *prefix, const char *suffix)
 {
     int i;
-    lily_value **values = v->value.container->values;
+    lily_value *values = v->value.container->values;
     int count = v->value.container->num_values;
 
     lily_mb_add(msgbuf, prefix);
@@ -492,11 +492,11 @@ static void add_list_like(lily_vm_state *vm, lily_msgbuf *msgbuf, tag *t,
     /* This is necessary because num_values is unsigned. */
     if (count != 0) {
         for (i = 0;i < count - 1;i++) {
-            add_value_to_msgbuf(vm, msgbuf, t, values[i]);
+            add_value_to_msgbuf(vm, msgbuf, t, &values[i]);
             lily_mb_add(msgbuf, ", ");
         }
         if (i != count)
-            add_value_to_msgbuf(vm, msgbuf, t, values[i]);
+            add_value_to_msgbuf(vm, msgbuf, t, &values[i]);
     }
 
     lily_mb_add(msgbuf, suffix);
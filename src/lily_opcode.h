@@ -82,6 +82,9 @@ typedef enum {
     /* Perform a call. The source is a register that may have a native or
        foreign function. */
     o_call_register,
+    /* Perform a call. The source is a vtable index, and the first argument is
+       the instance whose vtable is used. */
+    o_call_virt,
 
     /* Returns the value given to the caller. */
     o_return_value,
@@ -93,6 +96,10 @@ typedef enum {
     o_build_list,
     /* Build a Tuple of a given size and values. */
     o_build_tuple,
+    /* o_build_tuple, except that the Tuple is only read by property access on
+       the register it is built into. The vm fills the Tuple that is already in
+       that register again if nothing else holds it. */
+    o_build_tuple_local,
     /* Build a Hash of a given size and key+value pairs. The size provided is
        the total number of registers sent, not the number of pairs. */
     o_build_hash,
@@ -100,10 +107,32 @@ typedef enum {
        Use o_load_empty_variant to load empty variant values. */
     o_build_variant,
 
-    /* Perform a subscript access (index is a value). */
-    o_subscript_get,
-    /* Perform a subscript assignment (index is a value). */
-    o_subscript_set,
+    /* Subscripts have an opcode for each kind of container. The index is a
+       register, and is checked by the vm. Tuple subscripts use o_property_get
+       and o_property_set, because their index is checked by the emitter.
+       There are also opcodes for a List or Hash index that is a literal. */
+
+    /* Get an element of a List. */
+    o_list_get,
+    /* Set an element of a List. */
+    o_list_set,
+    /* Get a Byte from a String or ByteString. */
+    o_bytestring_get,
+    /* Set a Byte of a ByteString. */
+    o_bytestring_set,
+    /* Get the value of a key in a Hash. */
+    o_hash_get,
+    /* Set the value of a key in a Hash. */
+    o_hash_set,
+    /* o_hash_get, except that the key is a String from vm's readonly_table.
+       The emitter writes the hash of that key into the bytecode, so that the
+       vm does not have to find it on each access. */
+    o_hash_get_literal,
+    /* o_list_get, except that the index is an Integer literal in the bytecode
+       (as a 16-bit SIGNED value). The index is first, then the List. */
+    o_list_get_literal,
+    /* Like above, except for setting instead of getting. */
+    o_list_set_literal,
 
     /* Get a global value. An index is written in the bytecode. */
     o_global_get,
@@ -127,7 +156,7 @@ typedef enum {
     /* Create a new instance of some class id, or return the one being built if
        in a superclass. */
     o_instance_new,
-    /* o_subscript_get, except that the index is non-negative, checked, and in
+    /* o_list_get, except that the index is non-negative, checked, and in
        bytecode instead of a register. This can be used on anything that is a
        container. This is used to implement class property access and
        decomposition of enums. */
@@ -138,14 +167,15 @@ typedef enum {
     /* Fetch a method from the vtable of a class instance. */
     o_virt_get,
 
-    /* Push a catch entry. It's expected that this will be followed by
-       o_exception_catch. */
-    o_catch_push,
-    /* Pop a catch entry. Written when the catch isn't used or when exiting from
-       a `try` block. */
-    o_catch_pop,
+    /* Like o_property_get, but for the traceback of an Exception. Exception
+       capture saves a traceback's frames in hidden slots, and this builds the
+       traceback from them the first time it is read. */
+    o_traceback_get,
+
     /* This is given the class id of some exception-based class, and a jump
-       position. If the catch succeeds, then control returns to just after this
+       position. Try blocks don't write any code. Instead, the catch table of
+       the function says where the try blocks are, and where their first except
+       is. If the catch succeeds, then control returns to just after this
        opcode.
        For every `except` but the last, the jump points to the next `except`.
        The last jump will have a distance of 0 (which is invalid). */
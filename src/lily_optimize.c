@@ -0,0 +1,542 @@
+#include <string.h>
+
+#include "lily_alloc.h"
+#include "lily_code_iter.h"
+#include "lily_opcode.h"
+#include "lily_optimize.h"
+
+/* This is a peephole pass that runs on a function's code once the emitter is
+   done with it. The passes are:
+
+   * Jump threading: A jump that lands on an `o_jump` goes to where that jump
+     goes instead. An `o_jump` that lands on `o_return_unit` becomes a copy of
+     it, since they are the same size.
+   * No-op moves: `o_assign` from a register to itself is removed.
+   * Dead stores: A load or math op into a storage is removed if the storage is
+     written again before it is read, without leaving straight-line code.
+   * Copy propagation: When an op writes to a storage, and the next op assigns
+     that storage to a var, the first op writes to the var directly.
+   * Jumps that land on the next instruction are removed.
+   * Local Tuples: `o_build_tuple` becomes `o_build_tuple_local` if the only
+     other reads of its register are property access on it. That Tuple can't
+     be copied out, so the vm can fill it again on the next build.
+
+   Only storages are considered for dead stores. Storages hold values for the
+   expression that made them, so an `except` clause can't see them. Vars may be
+   read by an `except` clause if a call in between raises.
+
+   Removing code shifts everything after it, so jumps and the catch table are
+   fixed at the end. Line numbers are inside of instructions, so they move with
+   the instruction. */
+
+/* How many instructions dead store elimination will look ahead. This keeps the
+   pass from going quadratic on large functions. */
+#define STORE_WINDOW 32
+
+/* Jump threading stops after this many hops, in case of a loop of jumps. */
+#define THREAD_LIMIT 8
+
+typedef struct {
+    uint16_t *code;
+    lily_code_iter *ops;
+    uint16_t *index_at;
+    uint8_t *dead;
+    uint8_t *is_target;
+    const uint8_t *storages;
+    uint16_t op_count;
+    uint16_t code_size;
+} lily_opt_state;
+
+static uint16_t output_spot(lily_code_iter *ci)
+{
+    return ci->offset + 1 + ci->special_1 + ci->counter_2 + ci->inputs_3;
+}
+
+static uint16_t jump_spot(lily_code_iter *ci)
+{
+    return output_spot(ci) + ci->outputs_4;
+}
+
+/* Specials can be registers (`o_call_register`), so they count as reads. */
+static int reads_register(uint16_t *code, lily_code_iter *ci, uint16_t reg)
+{
+    uint16_t i, stop = output_spot(ci);
+
+    for (i = ci->offset + 1;i < stop;i++) {
+        if (code[i] == reg)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int writes_register(uint16_t *code, lily_code_iter *ci, uint16_t reg)
+{
+    uint16_t i = output_spot(ci);
+    uint16_t stop = i + ci->outputs_4;
+
+    for (;i < stop;i++) {
+        if (code[i] == reg)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int is_threadable_jump(uint16_t opcode)
+{
+    switch (opcode) {
+        case o_compare_eq:
+        case o_compare_greater:
+        case o_compare_greater_eq:
+        case o_compare_not_eq:
+        case o_jump:
+        case o_jump_if:
+        case o_jump_if_not_class:
+        case o_jump_if_set:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_signed_jump(uint16_t opcode)
+{
+    return opcode == o_jump || opcode == o_jump_if;
+}
+
+/* These write to their output and do nothing else. */
+static int is_pure_store(uint16_t opcode)
+{
+    switch (opcode) {
+        case o_assign:
+        case o_assign_noref:
+        case o_closure_get:
+        case o_double_promotion:
+        case o_global_get:
+        case o_int_add:
+        case o_int_bitwise_and:
+        case o_int_bitwise_or:
+        case o_int_bitwise_xor:
+        case o_int_minus:
+        case o_int_multiply:
+        case o_load_boolean:
+        case o_load_byte:
+        case o_load_empty_variant:
+        case o_load_integer:
+        case o_load_readonly:
+        case o_number_add:
+        case o_number_minus:
+        case o_number_multiply:
+        case o_unary_bitwise_not:
+        case o_unary_minus:
+        case o_unary_not:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* These can write to a var instead of a storage. They read all of their inputs
+   before writing, and may raise before the write but not after. */
+static int is_producer(uint16_t opcode)
+{
+    switch (opcode) {
+        case o_build_hash:
+        case o_build_list:
+        case o_build_tuple:
+        case o_bytestring_get:
+        case o_hash_get:
+        case o_hash_get_literal:
+        case o_int_divide:
+        case o_int_left_shift:
+        case o_int_modulo:
+        case o_int_right_shift:
+        case o_interpolation:
+        case o_list_get:
+        case o_list_get_literal:
+        case o_number_divide:
+        case o_property_get:
+            return 1;
+        default:
+            return is_pure_store(opcode);
+    }
+}
+
+static int is_exit(uint16_t opcode)
+{
+    return opcode == o_exception_raise ||
+           opcode == o_return_unit ||
+           opcode == o_return_value ||
+           opcode == o_vm_exit;
+}
+
+/* Is the value in 'reg' written again before anything reads it, starting from
+   the op at 'start'? This gives up at anything that might jump. */
+static int is_dead_value(lily_opt_state *st, uint16_t start, uint16_t reg)
+{
+    uint16_t i, stop = start + STORE_WINDOW;
+
+    if (stop > st->op_count)
+        stop = st->op_count;
+
+    for (i = start;i < stop;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i])
+            continue;
+
+        if (ci->jumps_5 || is_exit(ci->opcode) ||
+            reads_register(st->code, ci, reg))
+            return 0;
+
+        if (writes_register(st->code, ci, reg))
+            return 1;
+    }
+
+    return 0;
+}
+
+static uint16_t thread_jumps(lily_opt_state *st)
+{
+    uint16_t *code = st->code;
+    uint16_t i, count = 0;
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (is_threadable_jump(ci->opcode) == 0)
+            continue;
+
+        uint16_t spot = jump_spot(ci);
+        uint16_t start = ci->offset;
+        uint16_t target = start + code[spot];
+        uint16_t hops;
+
+        if (code[spot] == 0)
+            continue;
+
+        for (hops = 0;hops < THREAD_LIMIT;hops++) {
+            if (target >= st->code_size ||
+                code[target] != o_jump ||
+                code[target + 1] == 0)
+                break;
+
+            uint16_t next = target + code[target + 1];
+
+            /* The vm reads other jumps as unsigned, so they go forward. */
+            if (next <= start && is_signed_jump(ci->opcode) == 0)
+                break;
+
+            target = next;
+        }
+
+        if (hops) {
+            code[spot] = target - start;
+            count++;
+        }
+
+        if (ci->opcode == o_jump &&
+            target < st->code_size &&
+            code[target] == o_return_unit) {
+            code[start] = o_return_unit;
+            code[start + 1] = code[target + 1];
+            ci->opcode = o_return_unit;
+            ci->jumps_5 = 0;
+            ci->line_6 = 1;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static void mark_targets(lily_opt_state *st)
+{
+    uint16_t *code = st->code;
+    uint16_t i;
+
+    memset(st->is_target, 0, st->op_count);
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (ci->jumps_5 == 0)
+            continue;
+
+        uint16_t target = ci->offset + code[jump_spot(ci)];
+
+        if (target < st->code_size)
+            st->is_target[st->index_at[target]] = 1;
+
+        /* The vm enters the except clause right after this. */
+        if (ci->opcode == o_exception_catch && i + 1 < st->op_count)
+            st->is_target[i + 1] = 1;
+    }
+}
+
+static uint16_t remove_dead_stores(lily_opt_state *st)
+{
+    uint16_t *code = st->code;
+    uint16_t i, count = 0;
+
+    /* Go backward so that a store read only by a dead store is dead too. */
+    for (i = st->op_count;i > 0;i--) {
+        lily_code_iter *ci = &st->ops[i - 1];
+
+        if (is_pure_store(ci->opcode) == 0)
+            continue;
+
+        uint16_t out = code[output_spot(ci)];
+
+        if ((ci->opcode == o_assign || ci->opcode == o_assign_noref) &&
+            code[ci->offset + 1] == out) {
+            st->dead[i - 1] = 1;
+            count++;
+        }
+        else if (st->storages[out] && is_dead_value(st, i, out)) {
+            st->dead[i - 1] = 1;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static uint16_t propagate_copies(lily_opt_state *st)
+{
+    uint16_t *code = st->code;
+    uint16_t i, j, count = 0;
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i] ||
+            is_producer(ci->opcode) == 0 ||
+            ci->outputs_4 != 1)
+            continue;
+
+        uint16_t out_spot = output_spot(ci);
+        uint16_t storage = code[out_spot];
+
+        if (st->storages[storage] == 0)
+            continue;
+
+        /* Anything landing between the two ops would skip the producer. */
+        for (j = i + 1;j < st->op_count;j++) {
+            if (st->is_target[j] || st->dead[j] == 0)
+                break;
+        }
+
+        if (j == st->op_count || st->is_target[j])
+            continue;
+
+        lily_code_iter *assign = &st->ops[j];
+        uint16_t source = code[assign->offset + 1];
+        uint16_t var = code[assign->offset + 2];
+
+        if ((assign->opcode != o_assign &&
+             assign->opcode != o_assign_noref) ||
+            source != storage ||
+            var == storage ||
+            reads_register(code, ci, var) ||
+            is_dead_value(st, j + 1, storage) == 0)
+            continue;
+
+        code[out_spot] = var;
+        st->dead[j] = 1;
+        count++;
+    }
+
+    return count;
+}
+
+static uint16_t remove_jumps_to_next(lily_opt_state *st)
+{
+    uint16_t *code = st->code;
+    uint16_t i, j, count = 0;
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i] || ci->opcode != o_jump)
+            continue;
+
+        int16_t distance = (int16_t)code[ci->offset + 1];
+
+        if (distance <= 0)
+            continue;
+
+        uint16_t target = ci->offset + distance;
+
+        for (j = i + 1;j < st->op_count;j++) {
+            if (st->ops[j].offset >= target || st->dead[j] == 0)
+                break;
+        }
+
+        if (j == st->op_count || st->ops[j].offset == target) {
+            st->dead[i] = 1;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Does anything read 'reg' other than property access on it? Anything else
+   (a call, a return, an assign, a closure) might keep a copy of the value. */
+static int register_escapes(lily_opt_state *st, uint16_t reg)
+{
+    uint16_t *code = st->code;
+    uint16_t i;
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i] || reads_register(code, ci, reg) == 0)
+            continue;
+
+        uint16_t *op = code + ci->offset;
+
+        /* The index is first, then the container, then the value to set. */
+        if (ci->opcode == o_property_get && op[1] != reg)
+            continue;
+
+        if (ci->opcode == o_property_set && op[1] != reg && op[3] != reg)
+            continue;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint16_t mark_local_tuples(lily_opt_state *st)
+{
+    uint16_t *code = st->code;
+    uint16_t i, count = 0;
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i] ||
+            ci->opcode != o_build_tuple ||
+            register_escapes(st, code[output_spot(ci)]))
+            continue;
+
+        code[ci->offset] = o_build_tuple_local;
+        ci->opcode = o_build_tuple_local;
+        count++;
+    }
+
+    return count;
+}
+
+/* Where 'pos' (an old instruction start or the end) moved to. Removed ops map
+   to the next op that stays. */
+static uint16_t new_pos(lily_opt_state *st, uint16_t *starts, uint16_t pos)
+{
+    if (pos >= st->code_size)
+        return starts[st->op_count];
+
+    return starts[st->index_at[pos]];
+}
+
+static void compact(lily_opt_state *st, uint16_t *catch_table)
+{
+    uint16_t *code = st->code;
+    uint16_t *starts = lily_malloc((st->op_count + 1) * sizeof(*starts));
+    uint16_t i, write_pos = 0;
+
+    for (i = 0;i < st->op_count;i++) {
+        starts[i] = write_pos;
+
+        if (st->dead[i] == 0)
+            write_pos += st->ops[i].round_total;
+    }
+
+    starts[st->op_count] = write_pos;
+
+    /* Fix jumps in place before anything moves. */
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i] || ci->jumps_5 == 0)
+            continue;
+
+        uint16_t spot = jump_spot(ci);
+
+        /* A jump of 0 is either a loop onto itself, or the last except. */
+        if (code[spot] == 0)
+            continue;
+
+        uint16_t target = ci->offset + code[spot];
+
+        code[spot] = new_pos(st, starts, target) - starts[i];
+    }
+
+    if (catch_table) {
+        for (i = 1;i < catch_table[0];i++)
+            catch_table[i] = new_pos(st, starts, catch_table[i]);
+    }
+
+    for (i = 0;i < st->op_count;i++) {
+        lily_code_iter *ci = &st->ops[i];
+
+        if (st->dead[i] == 0 && starts[i] != ci->offset)
+            memmove(code + starts[i], code + ci->offset,
+                    ci->round_total * sizeof(*code));
+    }
+
+    st->code_size = write_pos;
+    lily_free(starts);
+}
+
+uint16_t lily_opt_function(uint16_t *code, uint16_t *code_size,
+        uint16_t *catch_table, const uint8_t *storages)
+{
+    lily_opt_state st;
+    lily_code_iter ci;
+    uint16_t size = *code_size;
+    uint16_t count = 0;
+
+    if (size == 0)
+        return 0;
+
+    st.code = code;
+    st.code_size = size;
+    st.storages = storages;
+    st.op_count = 0;
+    st.ops = lily_malloc(size * sizeof(*st.ops));
+    st.index_at = lily_malloc(size * sizeof(*st.index_at));
+
+    lily_ci_init(&ci, code, 0, size);
+
+    while (lily_ci_next(&ci)) {
+        st.index_at[ci.offset] = st.op_count;
+        st.ops[st.op_count] = ci;
+        st.op_count++;
+    }
+
+    st.dead = lily_malloc(st.op_count * sizeof(*st.dead));
+    st.is_target = lily_malloc(st.op_count * sizeof(*st.is_target));
+    memset(st.dead, 0, st.op_count);
+
+    count += thread_jumps(&st);
+    mark_targets(&st);
+    count += remove_dead_stores(&st);
+    count += propagate_copies(&st);
+    count += remove_jumps_to_next(&st);
+    count += mark_local_tuples(&st);
+
+    if (count)
+        compact(&st, catch_table);
+
+    *code_size = st.code_size;
+
+    lily_free(st.is_target);
+    lily_free(st.dead);
+    lily_free(st.index_at);
+    lily_free(st.ops);
+    return count;
+}
@@ -0,0 +1,13 @@
+#ifndef LILY_OPTIMIZE_H
+# define LILY_OPTIMIZE_H
+
+# include <stdint.h>
+
+/* Run peephole passes over the code of one function. The code is rewritten and
+   compacted in place, then 'code_size' and 'catch_table' (which may be NULL)
+   are fixed to match. 'storages' has a nonzero entry for each register that
+   holds a storage. The result is how many instructions were changed. */
+uint16_t lily_opt_function(uint16_t *code, uint16_t *code_size,
+        uint16_t *catch_table, const uint8_t *storages);
+
+#endif
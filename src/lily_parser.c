@@ -41,11 +41,11 @@ NEED_NEXT_TOK(tk_left_curly)
 NEED_CURRENT_TOK(tk_colon) \
 lily_next_token(lex);
 
-extern lily_type *lily_question_type;
-extern lily_class *lily_scoop_class;
-extern lily_class *lily_self_class;
-extern lily_type *lily_unit_type;
-extern lily_type *lily_unset_type;
+extern lily_type *const lily_question_type;
+extern lily_class *const lily_scoop_class;
+extern lily_class *const lily_self_class;
+extern lily_type *const lily_unit_type;
+extern lily_type *const lily_unset_type;
 
 /***
  *      ____       _
@@ -120,6 +120,7 @@ void lily_config_init(lily_config *conf)
     conf->sandbox = 0;
     conf->use_sys_dirs = 0;
     conf->sys_dirs = LILY_CONFIG_SYS_DIRS_INIT;
+    conf->optimize = 1;
 }
 
 /* This sets up the core of the interpreter. It's pretty rough around the edges,
@@ -635,6 +636,8 @@ static lily_function_val *make_new_function(lily_parse_state *parser,
     f->refcount = 1;
     f->foreign_func = NULL;
     f->code = NULL;
+    f->has_catch = 0;
+    f->is_parallel = 0;
     f->num_upvalues = 0;
     f->upvalues = NULL;
     f->gc_entry = NULL;
@@ -1641,6 +1644,11 @@ static void collect_call_args(lily_parse_state *parser, void *target,
     symbol. If a record has methods, the methods are always next, followed by
     variants/properties.
 
+    Functions are 'F' records, and methods are 'm' records. A foreign function
+    that several threads can call at once uses 'P' or 'p' instead. Such a
+    function only reads its arguments, returns a new value, and raises nothing
+    but the builtin errors.
+
     Toplevel symbols link to each other so that toplevel search doesn't match to
     a symbol that wouldn't be visible. The info table is always terminated with
     a "Z" record.
@@ -1731,6 +1739,14 @@ static char dyna_record_type(lily_dyna_state *ds)
     return ds->entry[0];
 }
 
+/* Methods are 'm' records, or 'p' records if they're parallel-safe. */
+static int dyna_is_method(lily_dyna_state *ds)
+{
+    char rec = dyna_record_type(ds);
+
+    return rec == 'm' || rec == 'p';
+}
+
 static char dyna_iter_next(lily_dyna_state *ds)
 {
     ds->index += (unsigned char)(ds->entry[1] + 1);
@@ -1752,7 +1768,7 @@ static void dyna_iter_past_methods(lily_dyna_state *ds)
     do {
         ds->index++;
         ds->entry = ds->table[ds->index];
-    } while (dyna_record_type(ds) == 'm');
+    } while (dyna_is_method(ds));
 }
 
 static int dyna_find_class_method(lily_dyna_state *ds, lily_class *cls,
@@ -1771,7 +1787,7 @@ static int dyna_find_class_method(lily_dyna_state *ds, lily_class *cls,
 
     int result = 0;
 
-    while (dyna_record_type(ds) == 'm') {
+    while (dyna_is_method(ds)) {
         if (dyna_name_is(ds, name)) {
             result = 1;
             break;
@@ -2242,7 +2258,14 @@ static void dynaload_function(lily_parse_state *parser, lily_dyna_state *ds)
 
     lily_function_val *f = make_new_function(parser, var);
 
+    char rec = dyna_record_type(ds);
+
     var->flags |= VAR_IS_FOREIGN_FUNC;
+
+    if (rec == 'P' || rec == 'p') {
+        var->flags |= VAR_IS_PARALLEL;
+        f->is_parallel = 1;
+    }
     collect_generics_for(parser, NULL);
     lily_tm_add(parser->tm, lily_unit_type);
     collect_call_args(parser, var, F_COLLECT_DYNALOAD);
@@ -2270,6 +2293,7 @@ static lily_item *run_dynaload(lily_parse_state *parser,
         case 'C': fn = dynaload_foreign; break;
         case 'E': fn = dynaload_enum; break;
         case 'F': fn = dynaload_function; break;
+        case 'P': fn = dynaload_function; break;
         case 'N': fn = dynaload_native; break;
         case 'R': fn = dynaload_var; break;
         case 'V': fn = dynaload_variant; break;
@@ -6179,6 +6203,9 @@ static void manifest_define(lily_parse_state *parser)
 
     keyword_define(parser);
 
+    /* Methods take this through modifiers, but toplevel defines don't. */
+    emit->block->scope_var->flags |= parser->modifiers & VAR_IS_PARALLEL;
+
     /* Close the definition to prevent storing code. */
     hide_block_vars(parser);
     lily_gp_restore(parser->generics, emit->block->generic_start);
@@ -6296,8 +6323,18 @@ static void manifest_var(lily_parse_state *parser)
 
 static void manifest_modifier(lily_parse_state *parser, int key)
 {
+    lily_lex_state *lex = parser->lex;
+
     key = read_modifiers(parser, key);
 
+    if (key == KEY_BAD_ID && strcmp(lex->label, "parallel") == 0) {
+        parser->modifiers |= VAR_IS_PARALLEL;
+        key = maybe_next_keyword(lex);
+
+        if (key != KEY_DEFINE)
+            lily_raise_syn(parser->raiser, "Expected 'define' here.");
+    }
+
     if (key == KEY_DEFINE) {
         if (parser->modifiers & (SYM_SCOPE_PROTECTED | SYM_SCOPE_PRIVATE))
             lily_raise_syn(parser->raiser,
@@ -6322,6 +6359,19 @@ static void manifest_modifier(lily_parse_state *parser, int key)
     parser->modifiers = 0;
 }
 
+/* Foreign functions that several threads can call at once are declared with
+   'parallel'. Bindgen writes their records as 'P' or 'p'. Such a function may
+   return its argument, but must not keep it or return a value inside of it,
+   because refcounts are not atomic. */
+static void manifest_parallel(lily_parse_state *parser)
+{
+    lily_next_token(parser->lex);
+    expect_word(parser, "define");
+    parser->modifiers = VAR_IS_PARALLEL;
+    manifest_define(parser);
+    parser->modifiers = 0;
+}
+
 static void manifest_forward(lily_parse_state *parser)
 {
     lily_block_type block_type = parser->emit->block->block_type;
@@ -6543,6 +6593,8 @@ static void manifest_loop(lily_parse_state *parser)
                 manifest_forward(parser);
             else if (strcmp("foreign", lex->label) == 0)
                 manifest_foreign(parser);
+            else if (strcmp("parallel", lex->label) == 0)
+                manifest_parallel(parser);
             else if (strcmp("library", lex->label) == 0)
                 manifest_library(parser);
             else if (strcmp("predefined", lex->label) == 0)
@@ -6631,6 +6683,7 @@ static int open_first_content(lily_state *s, const char *filename,
        using the parser's base jump is okay. */
     if (setjmp(parser->raiser->all_jumps->jump) == 0) {
         lily_ims_process_sys_dirs(parser, parser->config);
+        lily_ims_clear_dir_cache(parser->ims);
 
         lily_lex_entry_type load_type;
         void *load_content;
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lily.h"
+#include "lily_alloc.h"
+#include "lily_platform.h"
+#include "lily_vm.h"
+#define LILY_NO_EXPORT
+#include "lily_pkg_bench_bindings.h"
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    char *name;
+    /* Wall time of each measured call, sorted once they're all done. */
+    int64_t *samples;
+    uint32_t iterations;
+    uint32_t sweeps;
+    int64_t cpu_ns;
+    /* Values the gc started tracking. Values that can't be part of a cycle
+       (Strings, Lists of Integer, and so on) are not tagged. */
+    uint64_t gc_tags;
+} lily_bench_Report;
+
+static int64_t cpu_ns(void)
+{
+    return (int64_t)((double)clock() * 1000000000.0 / CLOCKS_PER_SEC);
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+/* This uses the nearest-rank method, so the result is always a sample. */
+static int64_t percentile(lily_bench_Report *r, uint32_t percent)
+{
+    uint64_t rank = ((uint64_t)r->iterations * percent + 99) / 100;
+
+    return r->samples[rank - 1];
+}
+
+static int64_t total_ns(lily_bench_Report *r)
+{
+    int64_t result = 0;
+    uint32_t i;
+
+    for (i = 0;i < r->iterations;i++)
+        result += r->samples[i];
+
+    return result;
+}
+
+static void add_json_string(lily_msgbuf *msgbuf, const char *source)
+{
+    lily_mb_add_char(msgbuf, '"');
+
+    for (;*source;source++) {
+        unsigned char ch = (unsigned char)*source;
+
+        if (ch == '"' || ch == '\\') {
+            lily_mb_add_char(msgbuf, '\\');
+            lily_mb_add_char(msgbuf, (char)ch);
+        }
+        else if (ch < ' ') {
+            char buffer[8];
+
+            sprintf(buffer, "\\u%04x", ch);
+            lily_mb_add(msgbuf, buffer);
+        }
+        else
+            lily_mb_add_char(msgbuf, (char)ch);
+    }
+
+    lily_mb_add_char(msgbuf, '"');
+}
+
+void lily_bench_destroy_Report(lily_bench_Report *r)
+{
+    lily_free(r->name);
+    lily_free(r->samples);
+}
+
+void lily_bench_Report_cpu_ns(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, r->cpu_ns);
+}
+
+void lily_bench_Report_gc_tags(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, (int64_t)r->gc_tags);
+}
+
+void lily_bench_Report_iterations(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, r->iterations);
+}
+
+void lily_bench_Report_max_ns(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, r->samples[r->iterations - 1]);
+}
+
+void lily_bench_Report_median_ns(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, percentile(r, 50));
+}
+
+void lily_bench_Report_min_ns(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, r->samples[0]);
+}
+
+void lily_bench_Report_name(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_string(s, r->name);
+}
+
+void lily_bench_Report_p99_ns(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, percentile(r, 99));
+}
+
+void lily_bench_Report_sweeps(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, r->sweeps);
+}
+
+void lily_bench_Report_to_json(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+    lily_msgbuf *msgbuf = lily_msgbuf_get(s);
+
+    lily_mb_add(msgbuf, "{\"name\": ");
+    add_json_string(msgbuf, r->name);
+    lily_mb_add_fmt(msgbuf,
+            ", \"iterations\": %d"
+            ", \"min_ns\": %ld"
+            ", \"median_ns\": %ld"
+            ", \"p99_ns\": %ld"
+            ", \"max_ns\": %ld"
+            ", \"total_ns\": %ld"
+            ", \"cpu_ns\": %ld"
+            ", \"gc_tags\": %ld"
+            ", \"sweeps\": %d}",
+            (int)r->iterations,
+            r->samples[0],
+            percentile(r, 50),
+            percentile(r, 99),
+            r->samples[r->iterations - 1],
+            total_ns(r),
+            r->cpu_ns,
+            (int64_t)r->gc_tags,
+            (int)r->sweeps);
+
+    lily_return_string(s, lily_mb_raw(msgbuf));
+}
+
+void lily_bench_Report_total_ns(lily_state *s)
+{
+    lily_bench_Report *r = ARG_Report(s, 0);
+
+    lily_return_integer(s, total_ns(r));
+}
+
+void lily_bench__run(lily_state *s)
+{
+    lily_function_val *fn = lily_arg_function(s, 0);
+    const char *name = lily_optional_string_raw(s, 1, "");
+    int64_t warmup = lily_optional_integer(s, 2, 1);
+    int64_t iterations = lily_optional_integer(s, 3, 10);
+
+    if (warmup < 0)
+        lily_ValueError(s, "Warmup must be >= 0 (%ld given).", warmup);
+
+    if (warmup > (int64_t)UINT32_MAX)
+        lily_ValueError(s, "Warmup is far too large (%ld given).", warmup);
+
+    if (iterations < 1)
+        lily_ValueError(s, "Iterations must be > 0 (%ld given).",
+                iterations);
+
+    if (iterations > (int64_t)UINT32_MAX)
+        lily_ValueError(s, "Iterations is far too large (%ld given).",
+                iterations);
+
+    /* The Report owns the buffers, so they're freed if fn raises. */
+    lily_bench_Report *r = INIT_Report(s);
+    lily_value *result = lily_stack_get_top(s);
+    uint32_t warmup_count = (uint32_t)warmup;
+    uint32_t count = (uint32_t)iterations;
+    uint32_t i;
+
+    r->name = lily_malloc((strlen(name) + 1) * sizeof(*r->name));
+    strcpy(r->name, name);
+    r->samples = lily_malloc(count * sizeof(*r->samples));
+    r->iterations = 0;
+    r->sweeps = 0;
+    r->cpu_ns = 0;
+    r->gc_tags = 0;
+
+    lily_call_prepare(s, fn);
+
+    for (i = 0;i < warmup_count;i++)
+        lily_call(s, 0);
+
+    lily_global_state *gs = s->gs;
+    uint64_t tag_start = gs->gc_tag_count;
+    uint32_t sweep_start = gs->gc_sweep_count;
+    int64_t cpu_start = cpu_ns();
+
+    for (i = 0;i < count;i++) {
+        int64_t start = lily_time_monotonic_ns();
+
+        lily_call(s, 0);
+        r->samples[i] = lily_time_monotonic_ns() - start;
+    }
+
+    r->cpu_ns = cpu_ns() - cpu_start;
+    r->gc_tags = gs->gc_tag_count - tag_start;
+    r->sweeps = gs->gc_sweep_count - sweep_start;
+    r->iterations = count;
+    qsort(r->samples, count, sizeof(*r->samples), compare_samples);
+
+    lily_return_value(s, result);
+}
+
+LILY_DECLARE_BENCH_CALL_TABLE
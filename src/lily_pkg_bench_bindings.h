@@ -0,0 +1,56 @@
+#ifndef LILY_BENCH_BINDINGS_H
+#define LILY_BENCH_BINDINGS_H
+/* Generated by lily-bindgen, do not edit. */
+
+#if defined(_WIN32) && !defined(LILY_NO_EXPORT)
+#define LILY_BENCH_EXPORT __declspec(dllexport)
+#else
+#define LILY_BENCH_EXPORT
+#endif
+
+#define ARG_Report(s_, i_) \
+(lily_bench_Report *)lily_arg_generic(s_, i_)
+#define AS_Report(v_) \
+(lily_bench_Report *)lily_as_generic(v_)
+#define ID_Report(s_) \
+lily_cid_at(s_, 0)
+#define INIT_Report(s_) \
+(lily_bench_Report *)lily_push_foreign(s_, ID_Report(s_), (lily_destroy_func)lily_bench_destroy_Report, sizeof(lily_bench_Report))
+
+LILY_BENCH_EXPORT
+const char *lily_bench_info_table[] = {
+    "\1Report\0"
+    ,"C\13Report\0"
+    ,"m\0cpu_ns\0(Report): Integer"
+    ,"m\0gc_tags\0(Report): Integer"
+    ,"m\0iterations\0(Report): Integer"
+    ,"m\0max_ns\0(Report): Integer"
+    ,"m\0median_ns\0(Report): Integer"
+    ,"m\0min_ns\0(Report): Integer"
+    ,"m\0name\0(Report): String"
+    ,"m\0p99_ns\0(Report): Integer"
+    ,"m\0sweeps\0(Report): Integer"
+    ,"m\0to_json\0(Report): String"
+    ,"m\0total_ns\0(Report): Integer"
+    ,"F\0run\0(Function(),:name *String,:warmup *Integer,:iterations *Integer): Report"
+    ,"Z"
+};
+#define LILY_DECLARE_BENCH_CALL_TABLE \
+LILY_BENCH_EXPORT \
+lily_call_entry_func lily_bench_call_table[] = { \
+    NULL, \
+    NULL, \
+    lily_bench_Report_cpu_ns, \
+    lily_bench_Report_gc_tags, \
+    lily_bench_Report_iterations, \
+    lily_bench_Report_max_ns, \
+    lily_bench_Report_median_ns, \
+    lily_bench_Report_min_ns, \
+    lily_bench_Report_name, \
+    lily_bench_Report_p99_ns, \
+    lily_bench_Report_sweeps, \
+    lily_bench_Report_to_json, \
+    lily_bench_Report_total_ns, \
+    lily_bench__run, \
+};
+#endif
@@ -8,11 +8,13 @@
 # include <windows.h>
 #else
 # include <dirent.h>
+# include <fcntl.h>
 # include <sys/stat.h>
 # include <unistd.h>
 #endif
 
 #include "lily.h"
+#include "lily_alloc.h"
 #include "lily_platform.h"
 #define LILY_NO_EXPORT
 #include "lily_pkg_fs_bindings.h"
@@ -31,6 +33,23 @@ typedef struct {
 #endif
 } lily_fs_Dir;
 
+/* What kind of path a WalkEntry is. */
+#define WALK_OTHER     0
+#define WALK_DIRECTORY 1
+#define WALK_FILE      2
+#define WALK_SYMLINK   3
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    char *path;
+    int64_t size;
+    int64_t mtime;
+    uint32_t depth;
+    uint16_t kind;
+    /* If 0, size and mtime are loaded when they are first asked for. */
+    uint16_t has_stat;
+} lily_fs_WalkEntry;
+
 #define HANDLE_RESULT \
 if (result == -1) { \
     char buffer[LILY_STRERROR_BUFFER_SIZE]; \
@@ -326,4 +345,281 @@ void lily_fs__remove_dir(lily_state *s)
     lily_return_unit(s);
 }
 
+void lily_fs_destroy_WalkEntry(lily_fs_WalkEntry *e)
+{
+    lily_free(e->path);
+}
+
+#ifndef _WIN32
+static void walk_entry_set_stat(lily_fs_WalkEntry *e, struct stat *sb)
+{
+    if (S_ISDIR(sb->st_mode))
+        e->kind = WALK_DIRECTORY;
+    else if (S_ISREG(sb->st_mode))
+        e->kind = WALK_FILE;
+    else if (S_ISLNK(sb->st_mode))
+        e->kind = WALK_SYMLINK;
+    else
+        e->kind = WALK_OTHER;
+
+    e->size = (int64_t)sb->st_size;
+    e->mtime = (int64_t)sb->st_mtime;
+    e->has_stat = 1;
+}
+#endif
+
+static void walk_entry_load_stat(lily_state *s, lily_fs_WalkEntry *e)
+{
+    if (e->has_stat)
+        return;
+
+#ifndef _WIN32
+    struct stat sb;
+    const char *dirname_raw = e->path;
+    int result;
+
+    errno = 0;
+    result = lstat(e->path, &sb);
+    HANDLE_RESULT
+
+    /* Keep the kind that the walk found, in case the path changed since. */
+    uint16_t kind = e->kind;
+
+    walk_entry_set_stat(e, &sb);
+    e->kind = kind;
+#else
+    (void)s;
+#endif
+}
+
+void lily_fs_WalkEntry_depth(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    lily_return_integer(s, e->depth);
+}
+
+void lily_fs_WalkEntry_is_dir(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    lily_return_boolean(s, e->kind == WALK_DIRECTORY);
+}
+
+void lily_fs_WalkEntry_is_file(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    lily_return_boolean(s, e->kind == WALK_FILE);
+}
+
+void lily_fs_WalkEntry_is_symlink(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    lily_return_boolean(s, e->kind == WALK_SYMLINK);
+}
+
+void lily_fs_WalkEntry_mtime(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    walk_entry_load_stat(s, e);
+    lily_return_integer(s, e->mtime);
+}
+
+void lily_fs_WalkEntry_path(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    lily_return_string(s, e->path);
+}
+
+void lily_fs_WalkEntry_size(lily_state *s)
+{
+    lily_fs_WalkEntry *e = ARG_WalkEntry(s, 0);
+
+    walk_entry_load_stat(s, e);
+    lily_return_integer(s, e->size);
+}
+
+static lily_fs_WalkEntry *push_walk_entry(lily_state *s, const char *dir,
+        const char *name, uint32_t depth)
+{
+    lily_fs_WalkEntry *e = INIT_WalkEntry(s);
+    size_t dir_size = strlen(dir);
+    size_t name_size = strlen(name);
+    int need_slash = (dir_size != 0 && name_size != 0 &&
+                      dir[dir_size - 1] != LILY_PATH_CHAR &&
+                      dir[dir_size - 1] != '/');
+
+    e->path = lily_malloc((dir_size + need_slash + name_size + 1) *
+            sizeof(*e->path));
+    memcpy(e->path, dir, dir_size);
+
+    if (need_slash)
+        e->path[dir_size] = LILY_PATH_CHAR;
+
+    memcpy(e->path + dir_size + need_slash, name, name_size + 1);
+    e->size = 0;
+    e->mtime = 0;
+    e->depth = depth;
+    e->kind = WALK_OTHER;
+    e->has_stat = 0;
+    return e;
+}
+
+/* Read every entry of 'dir' into 'batch', adding directories to 'pending' too.
+   The directory is closed before any entry is sent to a callback, so only one
+   directory is ever open, and a raise can't leak it. Returns 0 if the directory
+   could not be opened. */
+static int walk_read_dir(lily_state *s, lily_fs_WalkEntry *dir,
+        lily_container_val *pending, lily_container_val *batch)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATA fd;
+    lily_fs_WalkEntry *search = push_walk_entry(s, dir->path, "*", 0);
+    HANDLE h = FindFirstFile(search->path, &fd);
+
+    lily_stack_drop_top(s);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return 0;
+
+    do {
+        if (is_dot_or_dot_dot(fd.cFileName))
+            continue;
+
+        lily_fs_WalkEntry *e = push_walk_entry(s, dir->path, fd.cFileName,
+                dir->depth + 1);
+        DWORD attributes = fd.dwFileAttributes;
+        uint64_t write_time = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime
+                << 32) | fd.ftLastWriteTime.dwLowDateTime;
+
+        /* Reparse points (links and junctions) aren't followed, so that a walk
+           can't loop. */
+        if (attributes & FILE_ATTRIBUTE_REPARSE_POINT)
+            e->kind = WALK_SYMLINK;
+        else if (attributes & FILE_ATTRIBUTE_DIRECTORY)
+            e->kind = WALK_DIRECTORY;
+        else
+            e->kind = WALK_FILE;
+
+        /* Windows gives the size and time with each entry. The time is in
+           100ns ticks since 1601, so convert it to seconds since 1970. */
+        e->size = (int64_t)(((uint64_t)fd.nFileSizeHigh << 32) |
+                fd.nFileSizeLow);
+        e->mtime = (int64_t)(write_time / 10000000) - 11644473600LL;
+        e->has_stat = 1;
+
+        lily_list_push(batch, lily_stack_get_top(s));
+
+        if (e->kind == WALK_DIRECTORY)
+            lily_list_push(pending, lily_stack_get_top(s));
+
+        lily_stack_drop_top(s);
+    } while (FindNextFile(h, &fd));
+
+    FindClose(h);
+#else
+    DIR *d = opendir(dir->path);
+
+    if (d == NULL)
+        return 0;
+
+    while (1) {
+        struct dirent *de = readdir(d);
+
+        if (de == NULL)
+            break;
+
+        if (is_dot_or_dot_dot(de->d_name))
+            continue;
+
+        lily_fs_WalkEntry *e = push_walk_entry(s, dir->path, de->d_name,
+                dir->depth + 1);
+        int need_stat = 1;
+
+        /* Most systems say what kind of entry this is, which saves a stat call
+           for each entry. The size and time are loaded if they're asked for. */
+#ifdef DT_DIR
+        need_stat = 0;
+
+        if (de->d_type == DT_DIR)
+            e->kind = WALK_DIRECTORY;
+        else if (de->d_type == DT_REG)
+            e->kind = WALK_FILE;
+        else if (de->d_type == DT_LNK)
+            e->kind = WALK_SYMLINK;
+        else if (de->d_type == DT_UNKNOWN)
+            need_stat = 1;
+#endif
+
+        if (need_stat) {
+            struct stat sb;
+
+            if (fstatat(dirfd(d), de->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0)
+                walk_entry_set_stat(e, &sb);
+        }
+
+        lily_list_push(batch, lily_stack_get_top(s));
+
+        if (e->kind == WALK_DIRECTORY)
+            lily_list_push(pending, lily_stack_get_top(s));
+
+        lily_stack_drop_top(s);
+    }
+
+    closedir(d);
+#endif
+
+    return 1;
+}
+
+void lily_fs__walk(lily_state *s)
+{
+    const char *dirname_raw = lily_arg_string_raw(s, 0);
+    lily_container_val *pending = lily_push_list(s, 0);
+
+    push_walk_entry(s, dirname_raw, "", 0);
+    lily_list_push(pending, lily_stack_get_top(s));
+    lily_stack_drop_top(s);
+    lily_call_prepare(s, lily_arg_function(s, 1));
+
+    /* Directories are walked depth first, with 'pending' as a stack. */
+    while (lily_con_size(pending)) {
+        lily_list_take(s, pending, lily_con_size(pending) - 1);
+
+        lily_fs_WalkEntry *dir = AS_WalkEntry(lily_stack_get_top(s));
+        lily_container_val *batch = lily_push_list(s, 0);
+        int result = walk_read_dir(s, dir, pending, batch);
+
+        /* Only the starting directory has to be readable. Others are skipped,
+           since they may have changed or be forbidden. */
+        if (dir->depth == 0 && result == 0) {
+#ifdef _WIN32
+            lily_IOError(s, "Invalid or forbidden directory (%s).",
+                    dirname_raw);
+#else
+            result = -1;
+            HANDLE_RESULT
+#endif
+        }
+
+        uint32_t count = lily_con_size(batch);
+        uint32_t i;
+
+        for (i = 0;i < count;i++) {
+            lily_push_value(s, lily_con_get(batch, i));
+            lily_call(s, 1);
+        }
+
+        /* Drop the batch and the directory. */
+        lily_stack_drop_top(s);
+        lily_stack_drop_top(s);
+    }
+
+    lily_return_unit(s);
+}
+
 LILY_DECLARE_FS_CALL_TABLE
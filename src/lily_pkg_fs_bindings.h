@@ -26,19 +26,37 @@ lily_push_variant(state, (lily_cid_at(state, 1) + 1), 1)
 #define INIT_DirEntry_File(state)\
 lily_push_variant(state, (lily_cid_at(state, 1) + 2), 1)
 
+#define ARG_WalkEntry(s_, i_) \
+(lily_fs_WalkEntry *)lily_arg_generic(s_, i_)
+#define AS_WalkEntry(v_) \
+(lily_fs_WalkEntry *)lily_as_generic(v_)
+#define ID_WalkEntry(s_) \
+lily_cid_at(s_, 2)
+#define INIT_WalkEntry(s_) \
+(lily_fs_WalkEntry *)lily_push_foreign(s_, ID_WalkEntry(s_), (lily_destroy_func)lily_fs_destroy_WalkEntry, sizeof(lily_fs_WalkEntry))
+
 LILY_FS_EXPORT
 const char *lily_fs_info_table[] = {
-    "\2Dir\0DirEntry\0"
+    "\3Dir\0DirEntry\0WalkEntry\0"
     ,"C\1Dir\0"
     ,"m\0each_entry\0[A](Dir,A,Function(DirEntry,A)): A"
     ,"E\2DirEntry\0"
     ,"V\0Directory\0(String)"
     ,"V\0File\0(String)"
+    ,"C\7WalkEntry\0"
+    ,"m\0depth\0(WalkEntry): Integer"
+    ,"m\0is_dir\0(WalkEntry): Boolean"
+    ,"m\0is_file\0(WalkEntry): Boolean"
+    ,"m\0is_symlink\0(WalkEntry): Boolean"
+    ,"m\0mtime\0(WalkEntry): Integer"
+    ,"m\0path\0(WalkEntry): String"
+    ,"m\0size\0(WalkEntry): Integer"
     ,"F\0change_dir\0(String)"
     ,"F\0create_dir\0(String,*Integer)"
     ,"F\0current_dir\0: String"
     ,"F\0read_dir\0(String): Result[String,Dir]"
     ,"F\0remove_dir\0(String)"
+    ,"F\0walk\0(String,Function(WalkEntry))"
     ,"Z"
 };
 #define LILY_DECLARE_FS_CALL_TABLE \
@@ -50,10 +68,19 @@ lily_call_entry_func lily_fs_call_table[] = { \
     NULL, \
     NULL, \
     NULL, \
+    NULL, \
+    lily_fs_WalkEntry_depth, \
+    lily_fs_WalkEntry_is_dir, \
+    lily_fs_WalkEntry_is_file, \
+    lily_fs_WalkEntry_is_symlink, \
+    lily_fs_WalkEntry_mtime, \
+    lily_fs_WalkEntry_path, \
+    lily_fs_WalkEntry_size, \
     lily_fs__change_dir, \
     lily_fs__create_dir, \
     lily_fs__current_dir, \
     lily_fs__read_dir, \
     lily_fs__remove_dir, \
+    lily_fs__walk, \
 };
 #endif
@@ -1,5 +1,6 @@
 #include "lily_core_types.h"
 #include "lily_parser.h"
+#include "lily_profile.h"
 #include "lily_symtab.h"
 #include "lily_vm.h"
 
@@ -515,6 +516,12 @@ void lily_introspect_FunctionEntry_generics(lily_state *s)
     return_generics(s, get_var_generics(s, entry));
 }
 
+void lily_introspect_FunctionEntry_is_parallel(lily_state *s)
+{
+    UNPACK_FIRST_ARG(FunctionEntry, lily_var *);
+    lily_return_boolean(s, !!(entry->flags & VAR_IS_PARALLEL));
+}
+
 void lily_introspect_FunctionEntry_is_varargs(lily_state *s)
 {
     UNPACK_FIRST_ARG(FunctionEntry, lily_var *);
@@ -571,6 +578,16 @@ static char **get_doc_text(lily_state *s, uint16_t doc_id)
     return text;
 }
 
+void lily_introspect_FunctionEntry_optimize_count(lily_state *s)
+{
+    UNPACK_FIRST_ARG(FunctionEntry, lily_var *);
+
+    lily_emit_state *emit = s->gs->parser->emit;
+    lily_proto *proto = lily_emit_proto_for_var(emit, entry);
+
+    lily_return_integer(s, proto->optimize_count);
+}
+
 void lily_introspect_FunctionEntry_parameters(lily_state *s)
 {
     UNPACK_FIRST_ARG(FunctionEntry, lily_var *);
@@ -606,6 +623,11 @@ void lily_introspect_MethodEntry_is_forward_virtual(lily_state *s)
     lily_return_boolean(s, entry->item_kind == ITEM_FORWARD_VIRT);
 }
 
+void lily_introspect_MethodEntry_is_parallel(lily_state *s)
+{
+    lily_introspect_FunctionEntry_is_parallel(s);
+}
+
 void lily_introspect_MethodEntry_is_static(lily_state *s)
 {
     UNPACK_FIRST_ARG(MethodEntry, lily_var *);
@@ -623,6 +645,11 @@ void lily_introspect_MethodEntry_is_virtual(lily_state *s)
     lily_return_boolean(s, !!(entry->flags & VAR_IS_VIRTUAL));
 }
 
+void lily_introspect_MethodEntry_optimize_count(lily_state *s)
+{
+    lily_introspect_FunctionEntry_optimize_count(s);
+}
+
 void lily_introspect_MethodEntry_parameters(lily_state *s)
 {
     lily_introspect_FunctionEntry_parameters(s);
@@ -974,4 +1001,43 @@ void lily_introspect__module_list(lily_state *s)
     BUILD_LIST_FROM(allow_all, make_module);
 }
 
+void lily_introspect__profile_opcodes(lily_state *s)
+{
+    uint16_t i, count = 0;
+    const char *name;
+
+    for (i = 0;lily_profile_opcode_name(i) != NULL;i++) {
+        if (lily_profile_opcode_count(s, i))
+            count++;
+    }
+
+    lily_hash_val *h = lily_push_hash(s, count);
+
+    for (i = 0;(name = lily_profile_opcode_name(i)) != NULL;i++) {
+        uint64_t op_count = lily_profile_opcode_count(s, i);
+
+        if (op_count == 0)
+            continue;
+
+        lily_push_string(s, name);
+        lily_push_integer(s, (int64_t)op_count);
+        lily_hash_set_from_stack(s, h);
+    }
+
+    lily_return_top(s);
+}
+
+void lily_introspect__profile_report(lily_state *s)
+{
+    const char *report = lily_profile_report(s);
+
+    if (report == NULL) {
+        lily_return_none(s);
+        return;
+    }
+
+    lily_push_string(s, report);
+    lily_return_some_of_top(s);
+}
+
 LILY_DECLARE_INTROSPECT_CALL_TABLE
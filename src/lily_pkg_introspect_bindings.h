@@ -152,24 +152,28 @@ const char *lily_introspect_info_table[] = {
     ,"m\0name\0(EnumEntry): String"
     ,"m\0parent\0(EnumEntry): Option[ClassEntry]"
     ,"m\0variants\0(EnumEntry): List[VariantEntry]"
-    ,"C\10FunctionEntry\0"
+    ,"C\12FunctionEntry\0"
     ,"m\0doc\0(FunctionEntry): String"
     ,"m\0generics\0(FunctionEntry): List[TypeEntry]"
+    ,"m\0is_parallel\0(FunctionEntry): Boolean"
     ,"m\0is_varargs\0(FunctionEntry): Boolean"
     ,"m\0line_number\0(FunctionEntry): Integer"
     ,"m\0name\0(FunctionEntry): String"
+    ,"m\0optimize_count\0(FunctionEntry): Integer"
     ,"m\0parameters\0(FunctionEntry): List[ParameterEntry]"
     ,"m\0result_type\0(FunctionEntry): TypeEntry"
     ,"m\0type\0(FunctionEntry): TypeEntry"
-    ,"C\14MethodEntry\0"
+    ,"C\16MethodEntry\0"
     ,"m\0doc\0(MethodEntry): String"
     ,"m\0function_name\0(MethodEntry): String"
     ,"m\0generics\0(MethodEntry): List[TypeEntry]"
     ,"m\0is_forward_virtual\0(MethodEntry): Boolean"
+    ,"m\0is_parallel\0(MethodEntry): Boolean"
     ,"m\0is_static\0(MethodEntry): Boolean"
     ,"m\0is_varargs\0(MethodEntry): Boolean"
     ,"m\0is_virtual\0(MethodEntry): Boolean"
     ,"m\0line_number\0(MethodEntry): Integer"
+    ,"m\0optimize_count\0(MethodEntry): Integer"
     ,"m\0parameters\0(MethodEntry): List[ParameterEntry]"
     ,"m\0result_type\0(MethodEntry): TypeEntry"
     ,"m\0scope\0(MethodEntry): SymScope"
@@ -229,6 +233,8 @@ const char *lily_introspect_info_table[] = {
     ,"F\0class_name\0[A](A): String"
     ,"F\0main_module\0: ModuleEntry"
     ,"F\0module_list\0: List[ModuleEntry]"
+    ,"F\0profile_opcodes\0: Hash[String,Integer]"
+    ,"F\0profile_report\0: Option[String]"
     ,"Z"
 };
 #define LILY_DECLARE_INTROSPECT_CALL_TABLE \
@@ -262,9 +268,11 @@ lily_call_entry_func lily_introspect_call_table[] = { \
     NULL, \
     lily_introspect_FunctionEntry_doc, \
     lily_introspect_FunctionEntry_generics, \
+    lily_introspect_FunctionEntry_is_parallel, \
     lily_introspect_FunctionEntry_is_varargs, \
     lily_introspect_FunctionEntry_line_number, \
     lily_introspect_FunctionEntry_name, \
+    lily_introspect_FunctionEntry_optimize_count, \
     lily_introspect_FunctionEntry_parameters, \
     lily_introspect_FunctionEntry_result_type, \
     lily_introspect_FunctionEntry_type, \
@@ -273,10 +281,12 @@ lily_call_entry_func lily_introspect_call_table[] = { \
     lily_introspect_MethodEntry_function_name, \
     lily_introspect_MethodEntry_generics, \
     lily_introspect_MethodEntry_is_forward_virtual, \
+    lily_introspect_MethodEntry_is_parallel, \
     lily_introspect_MethodEntry_is_static, \
     lily_introspect_MethodEntry_is_varargs, \
     lily_introspect_MethodEntry_is_virtual, \
     lily_introspect_MethodEntry_line_number, \
+    lily_introspect_MethodEntry_optimize_count, \
     lily_introspect_MethodEntry_parameters, \
     lily_introspect_MethodEntry_result_type, \
     lily_introspect_MethodEntry_scope, \
@@ -336,5 +346,7 @@ lily_call_entry_func lily_introspect_call_table[] = { \
     lily_introspect__class_name, \
     lily_introspect__main_module, \
     lily_introspect__module_list, \
+    lily_introspect__profile_opcodes, \
+    lily_introspect__profile_report, \
 };
 #endif
@@ -0,0 +1,1036 @@
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <spawn.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <sys/wait.h>
+# include <unistd.h>
+# ifdef __linux__
+#  include <sys/epoll.h>
+#  include <sys/syscall.h>
+# else
+#  include <poll.h>
+# endif
+#endif
+
+#include "lily.h"
+#include "lily_alloc.h"
+#include "lily_platform.h"
+#include "lily_value.h"
+#include "lily_vm.h"
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    int fd;
+    /* The socket file is removed when the Listener closes. */
+    char *path;
+} lily_io_Listener;
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    int fd;
+} lily_io_Stream;
+
+/* Each task that a Loop is given has one of these. A task is a Coroutine that
+   is either ready to resume, waiting on a fd or a timer, or done. */
+typedef struct {
+    lily_coroutine_val *co;
+    /* The fd that this task is waiting on, or -1. */
+    int fd;
+    /* Either POLL_READ or POLL_WRITE. */
+    uint16_t events;
+    /* 1 if the fd was opened only for this wait, and closes after. */
+    uint16_t owns_fd;
+    /* Waiting functions are called again when the task resumes. This is set
+       when a timer wakes the task, so that sleep knows it's done. */
+    uint16_t is_woken;
+    uint16_t status;
+    /* How much of a write is already sent, so it's not sent again. */
+    uint32_t progress;
+    uint32_t pad;
+} lily_io_task;
+
+/* Timers are a heap ordered by deadline, then by when they were made. */
+typedef struct {
+    int64_t deadline;
+    uint32_t order;
+    uint32_t task_index;
+} lily_io_timer;
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    /* On Linux, this is an epoll fd. */
+    int poll_fd;
+    uint32_t is_running;
+    lily_io_task *tasks;
+    uint32_t task_count;
+    uint32_t task_size;
+    /* The ready queue is from ready_start to ready_end. */
+    uint32_t *ready;
+    uint32_t ready_start;
+    uint32_t ready_end;
+    uint32_t ready_size;
+    uint32_t timer_count;
+    uint32_t timer_size;
+    uint32_t timer_order;
+    lily_io_timer *timers;
+    /* The task being resumed, or NO_TASK. */
+    uint32_t current;
+    /* Tasks that are not done. */
+    uint32_t live_count;
+    /* Tasks waiting on a fd. */
+    uint32_t fd_wait_count;
+    uint32_t pad;
+} lily_io_RawLoop;
+
+#define LILY_NO_EXPORT
+#include "lily_pkg_io_bindings.h"
+
+#ifndef _WIN32
+
+extern char **environ;
+
+#define NO_TASK UINT32_MAX
+
+#define POLL_READ  0
+#define POLL_WRITE 1
+
+#define TASK_READY   0
+#define TASK_WAITING 1
+#define TASK_DONE    2
+
+/* Reads give back at most this many bytes at once. */
+#define READ_MAX 65536
+
+/* How long (in milliseconds) to wait before trying a connect or process wait
+   again when there's no fd to wait on. */
+#define RETRY_MS 2
+
+#define HANDLE_ERROR(detail_) \
+{ \
+    char buffer[LILY_STRERROR_BUFFER_SIZE]; \
+ \
+    lily_strerror(buffer); \
+    lily_IOError(s, "Errno %d: %s (%s).", errno, buffer, detail_); \
+}
+
+/* Make a fd from the io package non-blocking, and keep child processes from
+   getting it. */
+static void set_fd_flags(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void unix_address(lily_state *s, const char *path,
+        struct sockaddr_un *addr)
+{
+    if (strlen(path) >= sizeof(addr->sun_path))
+        lily_ValueError(s, "Socket path is too long.");
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+}
+
+/***
+ *      _     _     _
+ *     | |   (_)___| |_ ___ _ __   ___ _ __
+ *     | |   | / __| __/ _ \ '_ \ / _ \ '__|
+ *     | |___| \__ \ ||  __/ | | |  __/ |
+ *     |_____|_|___/\__\___|_| |_|\___|_|
+ *
+ */
+
+static void listener_close(lily_io_Listener *listener)
+{
+    close(listener->fd);
+    unlink(listener->path);
+    lily_free(listener->path);
+    listener->fd = -1;
+    listener->path = NULL;
+}
+
+void lily_io_destroy_Listener(lily_io_Listener *listener)
+{
+    if (listener->fd != -1)
+        listener_close(listener);
+}
+
+void lily_io_Listener_bind(lily_state *s)
+{
+    const char *path = lily_arg_string_raw(s, 0);
+    struct sockaddr_un addr;
+
+    unix_address(s, path, &addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd == -1)
+        HANDLE_ERROR(path)
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(fd, SOMAXCONN) == -1) {
+        int saved_errno = errno;
+
+        close(fd);
+        errno = saved_errno;
+        HANDLE_ERROR(path)
+    }
+
+    set_fd_flags(fd);
+
+    lily_io_Listener *listener = INIT_Listener(s);
+
+    listener->fd = fd;
+    listener->path = lily_malloc((strlen(path) + 1) * sizeof(*path));
+    strcpy(listener->path, path);
+    lily_return_top(s);
+}
+
+void lily_io_Listener_close(lily_state *s)
+{
+    lily_io_Listener *listener = ARG_Listener(s, 0);
+
+    if (listener->fd != -1)
+        listener_close(listener);
+
+    lily_return_unit(s);
+}
+
+/***
+ *      ____  _
+ *     / ___|| |_ _ __ ___  __ _ _ __ ___
+ *     \___ \| __| '__/ _ \/ _` | '_ ` _ \
+ *      ___) | |_| | |  __/ (_| | | | | | |
+ *     |____/ \__|_|  \___|\__,_|_| |_| |_|
+ *
+ */
+
+void lily_io_destroy_Stream(lily_io_Stream *stream)
+{
+    if (stream->fd != -1)
+        close(stream->fd);
+}
+
+static void push_stream(lily_state *s, int fd)
+{
+    lily_io_Stream *stream = INIT_Stream(s);
+
+    stream->fd = fd;
+}
+
+static int stream_fd(lily_state *s, lily_io_Stream *stream)
+{
+    if (stream->fd == -1)
+        lily_IOError(s, "IO operation on closed stream.");
+
+    return stream->fd;
+}
+
+void lily_io_Stream_close(lily_state *s)
+{
+    lily_io_Stream *stream = ARG_Stream(s, 0);
+
+    if (stream->fd != -1) {
+        close(stream->fd);
+        stream->fd = -1;
+    }
+
+    lily_return_unit(s);
+}
+
+void lily_io_Stream_open(lily_state *s)
+{
+    const char *path = lily_arg_string_raw(s, 0);
+    const char *mode = lily_arg_string_raw(s, 1);
+    int flags = O_RDONLY;
+
+    if (strcmp(mode, "w") == 0)
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (strcmp(mode, "a") == 0)
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+    else if (strcmp(mode, "r") != 0)
+        lily_IOError(s, "Invalid mode '%s' given.", mode);
+
+    int fd = open(path, flags, 0666);
+
+    if (fd == -1)
+        HANDLE_ERROR(path)
+
+    set_fd_flags(fd);
+    push_stream(s, fd);
+    lily_return_top(s);
+}
+
+void lily_io_Stream_pipe(lily_state *s)
+{
+    int fds[2];
+
+    if (pipe(fds) == -1)
+        HANDLE_ERROR("pipe")
+
+    set_fd_flags(fds[0]);
+    set_fd_flags(fds[1]);
+
+    lily_container_val *result = lily_push_tuple(s, 2);
+
+    push_stream(s, fds[0]);
+    lily_con_set_from_stack(s, result, 0);
+    push_stream(s, fds[1]);
+    lily_con_set_from_stack(s, result, 1);
+    lily_return_top(s);
+}
+
+/***
+ *      ____
+ *     |  _ \ _ __ ___   ___ ___  ___ ___
+ *     | |_) | '__/ _ \ / __/ _ \/ __/ __|
+ *     |  __/| | | (_) | (_|  __/\__ \__ \
+ *     |_|   |_|  \___/ \___\___||___/___/
+ *
+ */
+
+void lily_io_new_Process(lily_state *s)
+{
+    lily_container_val *command = lily_arg_container(s, 0);
+    uint32_t count = lily_con_size(command);
+
+    if (count == 0)
+        lily_ValueError(s, "Command cannot be empty.");
+
+    char **argv = lily_malloc((count + 1) * sizeof(*argv));
+    uint32_t i;
+
+    for (i = 0;i < count;i++)
+        argv[i] = lily_as_string_raw(lily_con_get(command, i));
+
+    argv[count] = NULL;
+
+    int in_fds[2], out_fds[2];
+
+    if (pipe(in_fds) == -1) {
+        lily_free(argv);
+        HANDLE_ERROR("pipe")
+    }
+
+    if (pipe(out_fds) == -1) {
+        int saved_errno = errno;
+
+        close(in_fds[0]);
+        close(in_fds[1]);
+        lily_free(argv);
+        errno = saved_errno;
+        HANDLE_ERROR("pipe")
+    }
+
+    /* The ends kept here must not leak into the child, or it will never see
+       the end of its input. */
+    set_fd_flags(in_fds[1]);
+    set_fd_flags(out_fds[0]);
+
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_fds[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, out_fds[1], 1);
+    posix_spawn_file_actions_addclose(&actions, in_fds[0]);
+    posix_spawn_file_actions_addclose(&actions, out_fds[1]);
+
+    int error = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    lily_free(argv);
+    close(in_fds[0]);
+    close(out_fds[1]);
+
+    if (error) {
+        close(in_fds[1]);
+        close(out_fds[0]);
+        errno = error;
+        HANDLE_ERROR(lily_as_string_raw(lily_con_get(command, 0)))
+    }
+
+    lily_container_val *con = SUPER_Process(s);
+
+    lily_push_integer(s, (int64_t)pid);
+    SETFS_Process__pid(s, con);
+    push_stream(s, in_fds[1]);
+    SETFS_Process__stdin(s, con);
+    push_stream(s, out_fds[0]);
+    SETFS_Process__stdout(s, con);
+    lily_return_super(s);
+}
+
+/***
+ *      _
+ *     | |    ___   ___  _ __
+ *     | |   / _ \ / _ \| '_ \
+ *     | |__| (_) | (_) | |_) |
+ *     |_____\___/ \___/| .__/
+ *                      |_|
+ */
+
+/** A Loop runs Coroutines (tasks) on one thread. When a task calls a Loop
+    method that would block, the method marks what the task is waiting on, then
+    suspends the task. The task is moved back to the start of the call, so that
+    it tries again once it's resumed. When nothing is ready, the Loop waits on
+    epoll (or poll off of Linux) until the next timer goes off. **/
+
+void lily_io_destroy_RawLoop(lily_io_RawLoop *raw)
+{
+    uint32_t i;
+
+    for (i = 0;i < raw->task_count;i++) {
+        lily_io_task *t = raw->tasks + i;
+
+        if (t->owns_fd)
+            close(t->fd);
+    }
+
+    if (raw->poll_fd != -1)
+        close(raw->poll_fd);
+
+    lily_free(raw->tasks);
+    lily_free(raw->ready);
+    lily_free(raw->timers);
+}
+
+void lily_io_new_Loop(lily_state *s)
+{
+    lily_container_val *con = SUPER_Loop(s);
+    lily_io_RawLoop *raw = INIT_RawLoop(s);
+
+    raw->is_running = 0;
+    raw->task_count = 0;
+    raw->task_size = 8;
+    raw->tasks = lily_malloc(raw->task_size * sizeof(*raw->tasks));
+    raw->ready_start = 0;
+    raw->ready_end = 0;
+    raw->ready_size = 8;
+    raw->ready = lily_malloc(raw->ready_size * sizeof(*raw->ready));
+    raw->timer_count = 0;
+    raw->timer_size = 8;
+    raw->timer_order = 0;
+    raw->timers = lily_malloc(raw->timer_size * sizeof(*raw->timers));
+    raw->current = NO_TASK;
+    raw->live_count = 0;
+    raw->fd_wait_count = 0;
+
+#ifdef __linux__
+    raw->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    raw->poll_fd = -1;
+#endif
+
+    SETFS_Loop__raw(s, con);
+    lily_push_list(s, 0);
+    SETFS_Loop__tasks(s, con);
+    lily_return_super(s);
+}
+
+static lily_io_RawLoop *raw_from_loop(lily_state *s)
+{
+    lily_container_val *con = lily_arg_container(s, 0);
+
+    return AS_RawLoop(GET_Loop__raw(con));
+}
+
+static void ready_push(lily_io_RawLoop *raw, uint32_t index)
+{
+    if (raw->ready_end == raw->ready_size) {
+        raw->ready_size *= 2;
+        raw->ready = lily_realloc(raw->ready,
+                raw->ready_size * sizeof(*raw->ready));
+    }
+
+    raw->tasks[index].status = TASK_READY;
+    raw->ready[raw->ready_end] = index;
+    raw->ready_end++;
+}
+
+static int timer_before(lily_io_timer *left, lily_io_timer *right)
+{
+    return left->deadline < right->deadline ||
+           (left->deadline == right->deadline && left->order < right->order);
+}
+
+static void timer_push(lily_io_RawLoop *raw, int64_t deadline, uint32_t index)
+{
+    if (raw->timer_count == raw->timer_size) {
+        raw->timer_size *= 2;
+        raw->timers = lily_realloc(raw->timers,
+                raw->timer_size * sizeof(*raw->timers));
+    }
+
+    lily_io_timer *timers = raw->timers;
+    lily_io_timer timer;
+    uint32_t i = raw->timer_count;
+
+    timer.deadline = deadline;
+    timer.order = raw->timer_order;
+    timer.task_index = index;
+    raw->timer_order++;
+    raw->timer_count++;
+
+    while (i) {
+        uint32_t parent = (i - 1) / 2;
+
+        if (timer_before(&timer, timers + parent) == 0)
+            break;
+
+        timers[i] = timers[parent];
+        i = parent;
+    }
+
+    timers[i] = timer;
+}
+
+static void timer_pop(lily_io_RawLoop *raw)
+{
+    lily_io_timer *timers = raw->timers;
+    uint32_t count = raw->timer_count - 1;
+    lily_io_timer last = timers[count];
+    uint32_t i = 0;
+
+    raw->timer_count = count;
+
+    while (1) {
+        uint32_t child = (i * 2) + 1;
+
+        if (child >= count)
+            break;
+
+        if (child + 1 < count && timer_before(timers + child + 1,
+                                              timers + child))
+            child++;
+
+        if (timer_before(&last, timers + child))
+            break;
+
+        timers[i] = timers[child];
+        i = child;
+    }
+
+    timers[i] = last;
+}
+
+static void fire_timers(lily_io_RawLoop *raw, int64_t now)
+{
+    while (raw->timer_count && raw->timers[0].deadline <= now) {
+        uint32_t index = raw->timers[0].task_index;
+
+        timer_pop(raw);
+        raw->tasks[index].is_woken = 1;
+        ready_push(raw, index);
+    }
+}
+
+static void wait_timer(lily_io_RawLoop *raw, uint32_t index, int64_t ms)
+{
+    timer_push(raw, lily_time_monotonic_ns() + (ms * 1000000), index);
+    raw->tasks[index].status = TASK_WAITING;
+}
+
+static void wait_fd(lily_state *s, lily_io_RawLoop *raw, uint32_t index,
+        int fd, uint16_t events)
+{
+#ifdef __linux__
+    struct epoll_event ev;
+
+    ev.events = (events == POLL_READ) ? EPOLLIN : EPOLLOUT;
+    ev.data.u64 = index;
+
+    if (epoll_ctl(raw->poll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        if (errno == EEXIST)
+            lily_RuntimeError(s,
+                    "Another task is already waiting on this stream.");
+
+        HANDLE_ERROR("epoll")
+    }
+#else
+    (void)s;
+#endif
+
+    lily_io_task *t = raw->tasks + index;
+
+    t->fd = fd;
+    t->events = events;
+    t->status = TASK_WAITING;
+    raw->fd_wait_count++;
+}
+
+static void wake_fd(lily_io_RawLoop *raw, uint32_t index)
+{
+    lily_io_task *t = raw->tasks + index;
+
+#ifdef __linux__
+    epoll_ctl(raw->poll_fd, EPOLL_CTL_DEL, t->fd, NULL);
+#endif
+
+    if (t->owns_fd) {
+        close(t->fd);
+        t->owns_fd = 0;
+    }
+
+    t->fd = -1;
+    raw->fd_wait_count--;
+    ready_push(raw, index);
+}
+
+/* Wait for up to 'timeout' milliseconds (-1 is forever) for a fd to be ready,
+   then put the tasks of any ready fds into the ready queue. */
+static int poll_fds(lily_io_RawLoop *raw, int timeout)
+{
+#ifdef __linux__
+    struct epoll_event events[64];
+    int count = epoll_wait(raw->poll_fd, events, 64, timeout);
+    int i;
+
+    for (i = 0;i < count;i++)
+        wake_fd(raw, (uint32_t)events[i].data.u64);
+#else
+    struct pollfd *fds = lily_malloc(
+            (raw->fd_wait_count + 1) * sizeof(*fds));
+    uint32_t *indexes = lily_malloc(
+            (raw->fd_wait_count + 1) * sizeof(*indexes));
+    uint32_t i, j = 0;
+
+    for (i = 0;i < raw->task_count;i++) {
+        lily_io_task *t = raw->tasks + i;
+
+        if (t->status != TASK_WAITING || t->fd == -1)
+            continue;
+
+        fds[j].fd = t->fd;
+        fds[j].events = (t->events == POLL_READ) ? POLLIN : POLLOUT;
+        fds[j].revents = 0;
+        indexes[j] = i;
+        j++;
+    }
+
+    int count = poll(fds, j, timeout);
+
+    for (i = 0;i < j && count > 0;i++) {
+        if (fds[i].revents)
+            wake_fd(raw, indexes[i]);
+    }
+
+    lily_free(indexes);
+    lily_free(fds);
+#endif
+
+    return count;
+}
+
+/* Every method that waits calls this first. It returns the index of the task
+   that is calling, or raises if the caller can't be suspended. */
+static uint32_t current_task(lily_state *s, lily_io_RawLoop *raw)
+{
+    uint32_t index = raw->current;
+
+    if (index == NO_TASK || raw->tasks[index].co->vm != s)
+        lily_RuntimeError(s, "Only a task of a running Loop can wait on it.");
+
+    if (lily_vm_coroutine_in_foreign_call(s))
+        lily_RuntimeError(s, "Cannot wait while in a foreign call.");
+
+    return index;
+}
+
+static void resume_task(lily_state *s, lily_io_RawLoop *raw, uint32_t index)
+{
+    lily_coroutine_val *co = raw->tasks[index].co;
+
+    /* The task may have been resumed to completion somewhere else. */
+    if (co->status == co_waiting) {
+        raw->current = index;
+        lily_vm_coroutine_resume(s, co, NULL);
+        lily_stack_drop_top(s);
+        raw->current = NO_TASK;
+    }
+
+    lily_io_task *t = raw->tasks + index;
+
+    if (co->status != co_waiting) {
+        t->status = TASK_DONE;
+        raw->live_count--;
+    }
+    else if (t->status == TASK_READY)
+        /* The task yielded on its own, so it goes to the back of the line. */
+        ready_push(raw, index);
+}
+
+static void run_ready_tasks(lily_state *s, lily_io_RawLoop *raw)
+{
+    /* Tasks that become ready while this runs wait until the next pass, so
+       that tasks that always yield can't starve the others. */
+    uint32_t end = raw->ready_end;
+
+    while (raw->ready_start < end) {
+        uint32_t index = raw->ready[raw->ready_start];
+
+        raw->ready_start++;
+        resume_task(s, raw, index);
+    }
+
+    uint32_t remaining = raw->ready_end - raw->ready_start;
+
+    memmove(raw->ready, raw->ready + raw->ready_start,
+            remaining * sizeof(*raw->ready));
+    raw->ready_start = 0;
+    raw->ready_end = remaining;
+}
+
+static void loop_reset(lily_state *s, lily_io_RawLoop *raw)
+{
+    uint32_t i;
+
+    for (i = 0;i < raw->task_count;i++) {
+        lily_io_task *t = raw->tasks + i;
+
+        if (t->fd == -1)
+            continue;
+
+#ifdef __linux__
+        epoll_ctl(raw->poll_fd, EPOLL_CTL_DEL, t->fd, NULL);
+#endif
+
+        if (t->owns_fd)
+            close(t->fd);
+    }
+
+    raw->is_running = 0;
+    raw->task_count = 0;
+    raw->ready_start = 0;
+    raw->ready_end = 0;
+    raw->timer_count = 0;
+    raw->live_count = 0;
+    raw->fd_wait_count = 0;
+
+    lily_container_val *con = lily_arg_container(s, 0);
+
+    lily_push_list(s, 0);
+    SETFS_Loop__tasks(s, con);
+}
+
+void lily_io_Loop_accept(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+    lily_io_Listener *listener = ARG_Listener(s, 1);
+
+    if (listener->fd == -1)
+        lily_IOError(s, "IO operation on closed listener.");
+
+    uint32_t index = current_task(s, raw);
+    int fd;
+
+    do {
+        fd = accept(listener->fd, NULL, NULL);
+    } while (fd == -1 && errno == EINTR);
+
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            HANDLE_ERROR("accept")
+
+        wait_fd(s, raw, index, listener->fd, POLL_READ);
+        lily_vm_coroutine_suspend(s, 2);
+    }
+
+    set_fd_flags(fd);
+    push_stream(s, fd);
+    lily_return_top(s);
+}
+
+void lily_io_Loop_connect(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+    const char *path = lily_arg_string_raw(s, 1);
+    struct sockaddr_un addr;
+
+    unix_address(s, path, &addr);
+
+    uint32_t index = current_task(s, raw);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd == -1)
+        HANDLE_ERROR(path)
+
+    set_fd_flags(fd);
+    raw->tasks[index].is_woken = 0;
+
+    int result;
+
+    do {
+        result = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+        int saved_errno = errno;
+
+        close(fd);
+        errno = saved_errno;
+
+        if (errno != EAGAIN && errno != EINPROGRESS)
+            HANDLE_ERROR(path)
+
+        /* The listener's backlog is full. There's no fd that says when it has
+           room again, so try again in a little bit. */
+        wait_timer(raw, index, RETRY_MS);
+        lily_vm_coroutine_suspend(s, 2);
+    }
+
+    push_stream(s, fd);
+    lily_return_top(s);
+}
+
+void lily_io_Loop_read(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+    int fd = stream_fd(s, ARG_Stream(s, 1));
+    int64_t size = lily_arg_integer(s, 2);
+
+    if (size < 0)
+        lily_ValueError(s, "Size must be >= 0 (%ld given).", size);
+
+    uint32_t index = current_task(s, raw);
+
+    if (size > READ_MAX)
+        size = READ_MAX;
+
+    char *data = lily_malloc((size + 1) * sizeof(*data));
+    ssize_t count;
+
+    do {
+        count = read(fd, data, (size_t)size);
+    } while (count == -1 && errno == EINTR);
+
+    if (count == -1) {
+        lily_free(data);
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            HANDLE_ERROR("read")
+
+        wait_fd(s, raw, index, fd, POLL_READ);
+        lily_vm_coroutine_suspend(s, 3);
+    }
+
+    lily_push_bytestring(s, data, (int)count);
+    lily_free(data);
+    lily_return_top(s);
+}
+
+void lily_io_Loop_run(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+
+    if (raw->is_running)
+        lily_RuntimeError(s, "Loop is already running.");
+
+    raw->is_running = 1;
+
+    while (1) {
+        run_ready_tasks(s, raw);
+
+        if (raw->live_count == 0)
+            break;
+
+        int timeout;
+
+        if (raw->ready_end)
+            timeout = 0;
+        else if (raw->timer_count) {
+            int64_t wait_ns = raw->timers[0].deadline -
+                    lily_time_monotonic_ns();
+
+            /* Round up, or the wait ends before the timer goes off. */
+            if (wait_ns <= 0)
+                timeout = 0;
+            else
+                timeout = (int)((wait_ns + 999999) / 1000000);
+        }
+        else if (raw->fd_wait_count)
+            timeout = -1;
+        else
+            /* The remaining tasks were resumed somewhere else. */
+            break;
+
+        if (poll_fds(raw, timeout) == -1 && errno != EINTR) {
+            int saved_errno = errno;
+
+            loop_reset(s, raw);
+            errno = saved_errno;
+            HANDLE_ERROR("poll")
+        }
+
+        fire_timers(raw, lily_time_monotonic_ns());
+    }
+
+    loop_reset(s, raw);
+    lily_return_unit(s);
+}
+
+void lily_io_Loop_sleep(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+    int64_t ms = lily_arg_integer(s, 1);
+
+    if (ms < 0)
+        lily_ValueError(s, "Sleep time must be >= 0 (%ld given).", ms);
+
+    uint32_t index = current_task(s, raw);
+    lily_io_task *t = raw->tasks + index;
+
+    if (t->is_woken) {
+        t->is_woken = 0;
+        lily_return_unit(s);
+        return;
+    }
+
+    wait_timer(raw, index, ms);
+    lily_vm_coroutine_suspend(s, 2);
+}
+
+void lily_io_Loop_spawn(lily_state *s)
+{
+    lily_container_val *con = lily_arg_container(s, 0);
+    lily_io_RawLoop *raw = AS_RawLoop(GET_Loop__raw(con));
+    lily_value *task_value = lily_arg_value(s, 1);
+
+    /* The task List holds the Coroutines so that the gc can find them. */
+    lily_list_push(lily_as_container(GET_Loop__tasks(con)), task_value);
+
+    if (raw->task_count == raw->task_size) {
+        raw->task_size *= 2;
+        raw->tasks = lily_realloc(raw->tasks,
+                raw->task_size * sizeof(*raw->tasks));
+    }
+
+    uint32_t index = raw->task_count;
+    lily_io_task *t = raw->tasks + index;
+
+    t->co = task_value->value.coroutine;
+    t->fd = -1;
+    t->events = 0;
+    t->owns_fd = 0;
+    t->is_woken = 0;
+    t->progress = 0;
+    raw->task_count++;
+    raw->live_count++;
+    ready_push(raw, index);
+    lily_return_unit(s);
+}
+
+void lily_io_Loop_wait(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+    lily_container_val *process = lily_arg_container(s, 1);
+    pid_t pid = (pid_t)lily_as_integer(GET_Process__pid(process));
+    uint32_t index = current_task(s, raw);
+    int status;
+    pid_t result;
+
+    do {
+        result = waitpid(pid, &status, WNOHANG);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1)
+        HANDLE_ERROR("waitpid")
+
+    if (result == 0) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+        /* A pidfd becomes readable when the process exits. Older kernels
+           don't have them, so fall back to checking again later. */
+        int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+
+        if (fd != -1) {
+            wait_fd(s, raw, index, fd, POLL_READ);
+            raw->tasks[index].owns_fd = 1;
+            lily_vm_coroutine_suspend(s, 2);
+        }
+#endif
+
+        raw->tasks[index].is_woken = 0;
+        wait_timer(raw, index, RETRY_MS);
+        lily_vm_coroutine_suspend(s, 2);
+    }
+
+    int64_t code;
+
+    if (WIFEXITED(status))
+        code = WEXITSTATUS(status);
+    else
+        code = -WTERMSIG(status);
+
+    lily_return_integer(s, code);
+}
+
+void lily_io_Loop_write(lily_state *s)
+{
+    lily_io_RawLoop *raw = raw_from_loop(s);
+    int fd = stream_fd(s, ARG_Stream(s, 1));
+    lily_bytestring_val *data = lily_arg_bytestring(s, 2);
+    const char *raw_data = lily_bytestring_raw(data);
+    uint32_t size = lily_bytestring_length(data);
+    uint32_t index = current_task(s, raw);
+    lily_io_task *t = raw->tasks + index;
+
+    while (t->progress < size) {
+        ssize_t count = write(fd, raw_data + t->progress,
+                size - t->progress);
+
+        if (count != -1) {
+            t->progress += (uint32_t)count;
+            continue;
+        }
+        else if (errno == EINTR)
+            continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            wait_fd(s, raw, index, fd, POLL_WRITE);
+            lily_vm_coroutine_suspend(s, 3);
+        }
+
+        t->progress = 0;
+        HANDLE_ERROR("write")
+    }
+
+    t->progress = 0;
+    lily_return_unit(s);
+}
+
+#else
+
+/* Windows doesn't have the fds that this package is built around. */
+#define UNSUPPORTED(name) \
+void lily_io_##name(lily_state *s) \
+{ \
+    lily_RuntimeError(s, "The io package is not supported on Windows."); \
+}
+
+void lily_io_destroy_Listener(lily_io_Listener *listener) { (void)listener; }
+void lily_io_destroy_RawLoop(lily_io_RawLoop *raw) { (void)raw; }
+void lily_io_destroy_Stream(lily_io_Stream *stream) { (void)stream; }
+
+UNSUPPORTED(Listener_bind)
+UNSUPPORTED(Listener_close)
+UNSUPPORTED(Loop_accept)
+UNSUPPORTED(Loop_connect)
+UNSUPPORTED(Loop_read)
+UNSUPPORTED(Loop_run)
+UNSUPPORTED(Loop_sleep)
+UNSUPPORTED(Loop_spawn)
+UNSUPPORTED(Loop_wait)
+UNSUPPORTED(Loop_write)
+UNSUPPORTED(new_Loop)
+UNSUPPORTED(new_Process)
+UNSUPPORTED(Stream_close)
+UNSUPPORTED(Stream_open)
+UNSUPPORTED(Stream_pipe)
+
+#endif
+
+LILY_DECLARE_IO_CALL_TABLE
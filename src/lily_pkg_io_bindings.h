@@ -0,0 +1,144 @@
+#ifndef LILY_IO_BINDINGS_H
+#define LILY_IO_BINDINGS_H
+/* Generated by lily-bindgen, do not edit. */
+
+#if defined(_WIN32) && !defined(LILY_NO_EXPORT)
+#define LILY_IO_EXPORT __declspec(dllexport)
+#else
+#define LILY_IO_EXPORT
+#endif
+
+#define ARG_Listener(s_, i_) \
+(lily_io_Listener *)lily_arg_generic(s_, i_)
+#define AS_Listener(v_) \
+(lily_io_Listener *)lily_as_generic(v_)
+#define ID_Listener(s_) \
+lily_cid_at(s_, 0)
+#define INIT_Listener(s_) \
+(lily_io_Listener *)lily_push_foreign(s_, ID_Listener(s_), (lily_destroy_func)lily_io_destroy_Listener, sizeof(lily_io_Listener))
+
+#define GET_Loop__raw(c_) \
+lily_con_get(c_, 0)
+#define SET_Loop__raw(c_, v_) \
+lily_con_set(c_, 0, v_)
+#define SETFS_Loop__raw(state, c_) \
+lily_con_set_from_stack(state, c_, 0)
+#define GET_Loop__tasks(c_) \
+lily_con_get(c_, 1)
+#define SET_Loop__tasks(c_, v_) \
+lily_con_set(c_, 1, v_)
+#define SETFS_Loop__tasks(state, c_) \
+lily_con_set_from_stack(state, c_, 1)
+#define ID_Loop(s_) \
+lily_cid_at(s_, 1)
+#define SUPER_Loop(s_) \
+lily_push_super(s_, ID_Loop(s_), 2)
+
+#define GET_Process__pid(c_) \
+lily_con_get(c_, 0)
+#define SET_Process__pid(c_, v_) \
+lily_con_set(c_, 0, v_)
+#define SETFS_Process__pid(state, c_) \
+lily_con_set_from_stack(state, c_, 0)
+#define GET_Process__stdin(c_) \
+lily_con_get(c_, 1)
+#define SET_Process__stdin(c_, v_) \
+lily_con_set(c_, 1, v_)
+#define SETFS_Process__stdin(state, c_) \
+lily_con_set_from_stack(state, c_, 1)
+#define GET_Process__stdout(c_) \
+lily_con_get(c_, 2)
+#define SET_Process__stdout(c_, v_) \
+lily_con_set(c_, 2, v_)
+#define SETFS_Process__stdout(state, c_) \
+lily_con_set_from_stack(state, c_, 2)
+#define ID_Process(s_) \
+lily_cid_at(s_, 2)
+#define SUPER_Process(s_) \
+lily_push_super(s_, ID_Process(s_), 3)
+
+#define ARG_RawLoop(s_, i_) \
+(lily_io_RawLoop *)lily_arg_generic(s_, i_)
+#define AS_RawLoop(v_) \
+(lily_io_RawLoop *)lily_as_generic(v_)
+#define ID_RawLoop(s_) \
+lily_cid_at(s_, 3)
+#define INIT_RawLoop(s_) \
+(lily_io_RawLoop *)lily_push_foreign(s_, ID_RawLoop(s_), (lily_destroy_func)lily_io_destroy_RawLoop, sizeof(lily_io_RawLoop))
+
+#define ARG_Stream(s_, i_) \
+(lily_io_Stream *)lily_arg_generic(s_, i_)
+#define AS_Stream(v_) \
+(lily_io_Stream *)lily_as_generic(v_)
+#define ID_Stream(s_) \
+lily_cid_at(s_, 4)
+#define INIT_Stream(s_) \
+(lily_io_Stream *)lily_push_foreign(s_, ID_Stream(s_), (lily_destroy_func)lily_io_destroy_Stream, sizeof(lily_io_Stream))
+
+extern LILY_IO_EXPORT const char *lily_coroutine_info_table[];
+extern LILY_IO_EXPORT lily_call_entry_func lily_coroutine_call_table[];
+void lily_io_module_coroutine(lily_state *s) { lily_import_library_data(s, "[coroutine]", lily_coroutine_info_table, lily_coroutine_call_table); }
+
+LILY_IO_EXPORT
+const char *lily_io_info_table[] = {
+    "\5Listener\0Loop\0Process\0RawLoop\0Stream\0"
+    ,"C\2Listener\0"
+    ,"m\0bind\0(String): Listener"
+    ,"m\0close\0(Listener)"
+    ,"N\13Loop\0"
+    ,"m\0<new>\0: Loop"
+    ,"m\0accept\0(Loop,Listener): Stream"
+    ,"m\0connect\0(Loop,String): Stream"
+    ,"m\0read\0(Loop,Stream,Integer): ByteString"
+    ,"m\0run\0(Loop)"
+    ,"m\0sleep\0(Loop,Integer)"
+    ,"m\0spawn\0(Loop,coroutine.Coroutine[Unit,Unit])"
+    ,"m\0wait\0(Loop,Process): Integer"
+    ,"m\0write\0(Loop,Stream,ByteString)"
+    ,"1\0raw\0RawLoop"
+    ,"1\0tasks\0List[coroutine.Coroutine[Unit,Unit]]"
+    ,"N\4Process\0"
+    ,"m\0<new>\0(List[String]): Process"
+    ,"3\0pid\0Integer"
+    ,"3\0stdin\0Stream"
+    ,"3\0stdout\0Stream"
+    ,"C\0RawLoop\0"
+    ,"C\3Stream\0"
+    ,"m\0close\0(Stream)"
+    ,"m\0open\0(String,String): Stream"
+    ,"m\0pipe\0: Tuple[Stream,Stream]"
+    ,"M\0coroutine"
+    ,"Z"
+};
+#define LILY_DECLARE_IO_CALL_TABLE \
+LILY_IO_EXPORT \
+lily_call_entry_func lily_io_call_table[] = { \
+    NULL, \
+    NULL, \
+    lily_io_Listener_bind, \
+    lily_io_Listener_close, \
+    NULL, \
+    lily_io_new_Loop, \
+    lily_io_Loop_accept, \
+    lily_io_Loop_connect, \
+    lily_io_Loop_read, \
+    lily_io_Loop_run, \
+    lily_io_Loop_sleep, \
+    lily_io_Loop_spawn, \
+    lily_io_Loop_wait, \
+    lily_io_Loop_write, \
+    NULL, \
+    NULL, \
+    NULL, \
+    lily_io_new_Process, \
+    NULL, \
+    NULL, \
+    NULL, \
+    NULL, \
+    NULL, \
+    lily_io_Stream_close, \
+    lily_io_Stream_open, \
+    lily_io_Stream_pipe, \
+    lily_io_module_coroutine, \
+};
+#endif
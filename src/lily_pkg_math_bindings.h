@@ -11,40 +11,40 @@
 LILY_MATH_EXPORT
 const char *lily_math_info_table[] = {
     "\0\0"
-    ,"F\0abs\0(Integer): Integer"
-    ,"F\0acos\0(Double): Double"
-    ,"F\0acosh\0(Double): Double"
-    ,"F\0asin\0(Double): Double"
-    ,"F\0asinh\0(Double): Double"
-    ,"F\0atan\0(Double): Double"
-    ,"F\0atan2\0(Double,Double): Double"
-    ,"F\0atanh\0(Double): Double"
-    ,"F\0cbrt\0(Double): Double"
-    ,"F\0ceil\0(Double): Double"
-    ,"F\0cos\0(Double): Double"
-    ,"F\0cosh\0(Double): Double"
-    ,"F\0exp\0(Double): Double"
-    ,"F\0exp2\0(Double): Double"
-    ,"F\0fabs\0(Double): Double"
-    ,"F\0floor\0(Double): Double"
-    ,"F\0fmod\0(Double,Double): Double"
-    ,"F\0hypot\0(Double,Double): Double"
-    ,"F\0is_infinity\0(Double): Boolean"
-    ,"F\0is_nan\0(Double): Boolean"
-    ,"F\0ldexp\0(Double,Integer): Double"
-    ,"F\0log\0(Double): Double"
-    ,"F\0log10\0(Double): Double"
-    ,"F\0log2\0(Double): Double"
-    ,"F\0modf\0(Double): Tuple[Double,Double]"
-    ,"F\0pow\0(Double,Double): Double"
-    ,"F\0round\0(Double): Double"
-    ,"F\0sin\0(Double): Double"
-    ,"F\0sinh\0(Double): Double"
-    ,"F\0sqrt\0(Double): Double"
-    ,"F\0tan\0(Double): Double"
-    ,"F\0tanh\0(Double): Double"
-    ,"F\0to_deg\0(Double): Double"
-    ,"F\0to_rad\0(Double): Double"
+    ,"P\0abs\0(Integer): Integer"
+    ,"P\0acos\0(Double): Double"
+    ,"P\0acosh\0(Double): Double"
+    ,"P\0asin\0(Double): Double"
+    ,"P\0asinh\0(Double): Double"
+    ,"P\0atan\0(Double): Double"
+    ,"P\0atan2\0(Double,Double): Double"
+    ,"P\0atanh\0(Double): Double"
+    ,"P\0cbrt\0(Double): Double"
+    ,"P\0ceil\0(Double): Double"
+    ,"P\0cos\0(Double): Double"
+    ,"P\0cosh\0(Double): Double"
+    ,"P\0exp\0(Double): Double"
+    ,"P\0exp2\0(Double): Double"
+    ,"P\0fabs\0(Double): Double"
+    ,"P\0floor\0(Double): Double"
+    ,"P\0fmod\0(Double,Double): Double"
+    ,"P\0hypot\0(Double,Double): Double"
+    ,"P\0is_infinity\0(Double): Boolean"
+    ,"P\0is_nan\0(Double): Boolean"
+    ,"P\0ldexp\0(Double,Integer): Double"
+    ,"P\0log\0(Double): Double"
+    ,"P\0log10\0(Double): Double"
+    ,"P\0log2\0(Double): Double"
+    ,"P\0modf\0(Double): Tuple[Double,Double]"
+    ,"P\0pow\0(Double,Double): Double"
+    ,"P\0round\0(Double): Double"
+    ,"P\0sin\0(Double): Double"
+    ,"P\0sinh\0(Double): Double"
+    ,"P\0sqrt\0(Double): Double"
+    ,"P\0tan\0(Double): Double"
+    ,"P\0tanh\0(Double): Double"
+    ,"P\0to_deg\0(Double): Double"
+    ,"P\0to_rad\0(Double): Double"
     ,"O\0huge\0Double"
     ,"O\0infinity\0Double"
     ,"O\0nan\0Double"
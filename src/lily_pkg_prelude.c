@@ -17,8 +17,8 @@
 /* When destroying a value with a gc tag, set the tag to this to prevent destroy
    from reentering it. The values are useless, but cannot be 0 or this will be
    optimized as a NULL pointer. */
-const lily_gc_entry *lily_gc_stopper =
-&(lily_gc_entry)
+lily_gc_entry *const lily_gc_stopper =
+(lily_gc_entry *)&(const lily_gc_entry)
 {
     1,
     1,
@@ -75,12 +75,15 @@ DEFINE_CONST_CLASS(raw_unset, LILY_ID_UNSET, 0, "", 0);
 
 #undef DEFINE_CONST_CLASS
 
-const lily_class *lily_scoop_class = &raw_scoop;
-const lily_class *lily_self_class = &raw_self;
-const lily_type *lily_question_type = (lily_type *)&raw_question;
-const lily_type *lily_scoop_type = (lily_type *)&raw_scoop;
-lily_type *lily_unit_type = (lily_type *)&raw_unit;
-const lily_type *lily_unset_type = (lily_type *)&raw_unset;
+/* These are shared by every interpreter in the process, including those running
+   on other threads. Nothing writes to them, and the pointers are const so that
+   nothing can. */
+lily_class *const lily_scoop_class = (lily_class *)&raw_scoop;
+lily_class *const lily_self_class = (lily_class *)&raw_self;
+lily_type *const lily_question_type = (lily_type *)&raw_question;
+lily_type *const lily_scoop_type = (lily_type *)&raw_scoop;
+lily_type *const lily_unit_type = (lily_type *)&raw_unit;
+lily_type *const lily_unset_type = (lily_type *)&raw_unset;
 
 static void return_exception(lily_state *s, uint16_t id)
 {
@@ -321,6 +324,13 @@ static void do_str_slice(lily_state *s, int is_bytestring)
             lily_push_string(s, "");
             return;
         }
+
+        /* String values can't be changed, so the whole one can be shared. A
+           ByteString still needs a copy. */
+        if (start == 0 && stop == input_size) {
+            lily_push_value(s, lily_arg_value(s, 0));
+            return;
+        }
     }
 
     if (is_bytestring == 0)
@@ -1093,12 +1103,8 @@ void lily_prelude_List_clear(lily_state *s)
     uint32_t input_size = lily_con_size(input_list);
     uint32_t i;
 
-    for (i = 0;i < input_size;i++) {
-        lily_value *v = lily_con_get(input_list, i);
-
-        lily_deref(v);
-        lily_free(v);
-    }
+    for (i = 0;i < input_size;i++)
+        lily_deref(lily_con_get(input_list, i));
 
     input_list->extra_space += input_list->num_values;
     input_list->num_values = 0;
@@ -1508,17 +1514,16 @@ static void list_select_reject_common(lily_state *s, int expect)
         if (i >= lily_con_size(input_list))
             break;
 
-        lily_value *v = lily_con_get(input_list, i);
-
-        lily_push_value(s, v);
+        lily_push_value(s, lily_con_get(input_list, i));
         lily_call(s, 1);
         i++;
 
         if (i > lily_con_size(input_list))
             break;
 
+        /* The call may have grown the List and moved the element. */
         if (lily_as_boolean(result) == expect)
-            lily_list_push(con, v);
+            lily_list_push(con, lily_con_get(input_list, i - 1));
     }
 }
 
@@ -2151,6 +2156,39 @@ void lily_prelude_String_html_encode(lily_state *s)
         lily_return_string(s, lily_mb_raw(msgbuf));
 }
 
+void lily_prelude_String_intern(lily_state *s)
+{
+    lily_global_state *gs = s->gs;
+    lily_value_stack *literals = gs->parser->symtab->literals;
+    lily_value *input_arg = lily_arg_value(s, 0);
+
+    if (gs->intern_table == NULL)
+        gs->intern_table = lily_new_hash_raw(0);
+
+    lily_hash_val *table = gs->intern_table;
+
+    /* Literals live until the interpreter is done, so they're held without a
+       ref. Add any that were made since the last call. */
+    while (gs->intern_literal_pos < literals->pos) {
+        lily_value *lit = literals->data[gs->intern_literal_pos];
+
+        if (lit->flags & V_STRING_FLAG &&
+            lily_hash_get(s, table, lit) == NULL)
+            lily_hash_set(s, table, lit, lit);
+
+        gs->intern_literal_pos++;
+    }
+
+    lily_value *result = lily_hash_get(s, table, input_arg);
+
+    if (result == NULL) {
+        lily_hash_set(s, table, input_arg, input_arg);
+        result = input_arg;
+    }
+
+    lily_return_value(s, result);
+}
+
 #define CTYPE_WRAP(WRAP_NAME, WRAPPED_CALL) \
 void lily_prelude_String_##WRAP_NAME(lily_state *s) \
 { \
@@ -2280,12 +2318,17 @@ void lily_prelude_String_lstrip(lily_state *s)
     const char *strip_str = lily_string_raw(strip_sv);
     int have_utf8 = is_utf8(strip_str);
 
+    int copy_from;
+
     if (have_utf8 == 0)
-        input_str += strspn(input_str, strip_str);
+        copy_from = (int)strspn(input_str, strip_str);
     else
-        input_str += lstrip_utf8_start(input_sv, strip_str);
+        copy_from = lstrip_utf8_start(input_sv, strip_str);
 
-    lily_return_string(s, input_str);
+    if (copy_from == 0)
+        lily_return_value(s, lily_arg_value(s, 0));
+    else
+        lily_return_string(s, input_str + copy_from);
 }
 
 void lily_prelude_String_parse_i(lily_state *s)
@@ -2433,6 +2476,11 @@ void lily_prelude_String_rstrip(lily_state *s)
     else
         copy_to = rstrip_utf8_stop(input_sv, strip_str);
 
+    if ((uint32_t)copy_to == input_size) {
+        lily_return_value(s, lily_arg_value(s, 0));
+        return;
+    }
+
     const char *input_str = lily_string_raw(input_sv);
 
     lily_push_string_sized(s, input_str, copy_to);
@@ -2589,6 +2637,11 @@ void lily_prelude_String_strip(lily_state *s)
     else
         copy_to = rstrip_utf8_stop(input_sv, strip_str);
 
+    if (copy_from == 0 && (uint32_t)copy_to == input_size) {
+        lily_return_value(s, lily_arg_value(s, 0));
+        return;
+    }
+
     lily_push_string_sized(s, input_str + copy_from, copy_to - copy_from);
     lily_return_top(s);
 }
@@ -2619,6 +2672,11 @@ void lily_prelude_String_trim(lily_state *s)
 
     int end = rstrip_ascii_stop(input_sv, to_skip) - (int)span;
 
+    if (span == 0 && (uint32_t)end == lily_string_length(input_sv)) {
+        lily_return_value(s, lily_arg_value(s, 0));
+        return;
+    }
+
     lily_push_string_sized(s, input_str, end);
     lily_return_top(s);
 }
@@ -12,10 +12,10 @@ LILY_PRELUDE_EXPORT
 const char *lily_prelude_info_table[] = {
     "\0\0"
     ,"C\2Boolean\0"
-    ,"m\0to_i\0(Boolean): Integer"
-    ,"m\0to_s\0(Boolean): String"
+    ,"p\0to_i\0(Boolean): Integer"
+    ,"p\0to_s\0(Boolean): String"
     ,"C\1Byte\0"
-    ,"m\0to_i\0(Byte): Integer"
+    ,"p\0to_i\0(Byte): Integer"
     ,"C\6ByteString\0"
     ,"m\0create\0(Integer,*Byte): ByteString"
     ,"m\0each_byte\0(ByteString,Function(Byte))"
@@ -26,7 +26,7 @@ const char *lily_prelude_info_table[] = {
     ,"N\1DivisionByZeroError\0< Exception"
     ,"m\0<new>\0(String): DivisionByZeroError"
     ,"C\1Double\0"
-    ,"m\0to_i\0(Double): Integer"
+    ,"p\0to_i\0(Double): Integer"
     ,"N\3Exception\0"
     ,"m\0<new>\0(String): Exception"
     ,"3\0message\0String"
@@ -61,13 +61,13 @@ const char *lily_prelude_info_table[] = {
     ,"N\1IndexError\0< Exception"
     ,"m\0<new>\0(String): IndexError"
     ,"C\7Integer\0"
-    ,"m\0to_binary\0(Integer): String"
-    ,"m\0to_bool\0(Integer): Boolean"
-    ,"m\0to_byte\0(Integer): Byte"
-    ,"m\0to_d\0(Integer): Double"
-    ,"m\0to_hex\0(Integer): String"
-    ,"m\0to_octal\0(Integer): String"
-    ,"m\0to_s\0(Integer): String"
+    ,"p\0to_binary\0(Integer): String"
+    ,"p\0to_bool\0(Integer): Boolean"
+    ,"p\0to_byte\0(Integer): Byte"
+    ,"p\0to_d\0(Integer): Double"
+    ,"p\0to_hex\0(Integer): String"
+    ,"p\0to_octal\0(Integer): String"
+    ,"p\0to_s\0(Integer): String"
     ,"N\1KeyError\0< Exception"
     ,"m\0<new>\0(String): KeyError"
     ,"C\36List\0[A]"
@@ -103,28 +103,29 @@ const char *lily_prelude_info_table[] = {
     ,"m\0zip\0[A](List[A],List[$1]...): List[Tuple[A,$1]]"
     ,"N\1RuntimeError\0< Exception"
     ,"m\0<new>\0(String): RuntimeError"
-    ,"C\25String\0"
+    ,"C\26String\0"
     ,"m\0ends_with\0(String,String): Boolean"
     ,"m\0find\0(String,String,:start *Integer): Option[Integer]"
     ,"m\0format\0(String,$1...): String"
     ,"m\0html_encode\0(String): String"
-    ,"m\0is_alnum\0(String): Boolean"
-    ,"m\0is_alpha\0(String): Boolean"
-    ,"m\0is_digit\0(String): Boolean"
-    ,"m\0is_space\0(String): Boolean"
-    ,"m\0lower\0(String): String"
+    ,"m\0intern\0(String): String"
+    ,"p\0is_alnum\0(String): Boolean"
+    ,"p\0is_alpha\0(String): Boolean"
+    ,"p\0is_digit\0(String): Boolean"
+    ,"p\0is_space\0(String): Boolean"
+    ,"p\0lower\0(String): String"
     ,"m\0lstrip\0(String,String): String"
-    ,"m\0parse_i\0(String): Option[Integer]"
+    ,"p\0parse_i\0(String): Option[Integer]"
     ,"m\0replace\0(String,String,String): String"
     ,"m\0rstrip\0(String,String): String"
-    ,"m\0size\0(String): Integer"
+    ,"p\0size\0(String): Integer"
     ,"m\0slice\0(String,*Integer,*Integer): String"
     ,"m\0split\0(String,*String,:max *Integer): List[String]"
     ,"m\0starts_with\0(String,String): Boolean"
     ,"m\0strip\0(String,String): String"
-    ,"m\0to_bytestring\0(String): ByteString"
-    ,"m\0trim\0(String): String"
-    ,"m\0upper\0(String): String"
+    ,"p\0to_bytestring\0(String): ByteString"
+    ,"p\0trim\0(String): String"
+    ,"p\0upper\0(String): String"
     ,"C\0Tuple\0"
     ,"C\0Unit\0"
     ,"N\1ValueError\0< Exception"
@@ -174,9 +175,9 @@ const char *lily_prelude_info_table[] = {
 #define List_OFFSET 60
 #define RuntimeError_OFFSET 91
 #define String_OFFSET 93
-#define Tuple_OFFSET 115
-#define Unit_OFFSET 116
-#define ValueError_OFFSET 117
+#define Tuple_OFFSET 116
+#define Unit_OFFSET 117
+#define ValueError_OFFSET 118
 #define LILY_DECLARE_PRELUDE_CALL_TABLE \
 LILY_PRELUDE_EXPORT \
 lily_call_entry_func lily_prelude_call_table[] = { \
@@ -278,6 +279,7 @@ lily_call_entry_func lily_prelude_call_table[] = { \
     lily_prelude_String_find, \
     lily_prelude_String_format, \
     lily_prelude_String_html_encode, \
+    lily_prelude_String_intern, \
     lily_prelude_String_is_alnum, \
     lily_prelude_String_is_alpha, \
     lily_prelude_String_is_digit, \
@@ -1,7 +1,9 @@
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 #include "lily.h"
+#include "lily_alloc.h"
 #define LILY_NO_EXPORT
 #include "lily_pkg_random_bindings.h"
 
@@ -66,23 +68,90 @@ void lily_random_new_Random(lily_state *s)
     lily_return_top(s);
 }
 
+static int64_t random_between(uint64_t state[4], int64_t start, int64_t end)
+{
+    uint64_t rng = random_u64(state);
+
+    if (start == end)
+        return start;
+
+    return start + rng % (end - start + 1);
+}
+
+/* The jump functions advance the state as far as 2^128 (jump) or 2^192
+   (long_jump) calls would. They come from the same source as the generator. */
+static void random_jump(uint64_t state[4], const uint64_t table[4])
+{
+    uint64_t result[4] = {0, 0, 0, 0};
+
+    for (int i = 0;i < 4;i++) {
+        for (int b = 0;b < 64;b++) {
+            if (table[i] & (uint64_t)1 << b) {
+                result[0] ^= state[0];
+                result[1] ^= state[1];
+                result[2] ^= state[2];
+                result[3] ^= state[3];
+            }
+
+            random_u64(state);
+        }
+    }
+
+    for (int i = 0;i < 4;i++)
+        state[i] = result[i];
+}
+
+static uint32_t count_arg(lily_state *s, int index)
+{
+    int64_t raw_count = lily_arg_integer(s, index);
+
+    if (raw_count < 0)
+        lily_ValueError(s, "Count must be >= 0 (%ld given).",
+                (int64_t)raw_count);
+
+    if (raw_count > (int64_t)UINT32_MAX)
+        lily_ValueError(s, "Count is far too large (%ld given).",
+                (int64_t)raw_count);
+
+    return (uint32_t)raw_count;
+}
+
 void lily_random_Random_between(lily_state *s)
 {
     lily_random_Random *r = ARG_Random(s, 0);
-    uint64_t rng = random_u64(r->state);
-
     int64_t start = lily_arg_integer(s, 1);
     int64_t end = lily_arg_integer(s, 2);
 
     if (start > end)
         lily_ValueError(s, "Interval range is reversed.");
 
-    if (start == end) {
-        lily_return_integer(s, start);
-        return;
+    lily_return_integer(s, random_between(r->state, start, end));
+}
+
+void lily_random_Random_bytes(lily_state *s)
+{
+    lily_random_Random *r = ARG_Random(s, 0);
+    uint32_t count = count_arg(s, 1);
+
+    /* ByteString sizes are int, and the buffer has 8 bytes of padding. */
+    if (count > INT32_MAX - 8)
+        lily_ValueError(s, "Count is far too large (%ld given).",
+                (int64_t)count);
+
+    uint64_t state[4] = {r->state[0], r->state[1], r->state[2], r->state[3]};
+    char *buffer = lily_malloc(((size_t)count + 8) * sizeof(*buffer));
+    uint32_t i;
+
+    /* Fill 8 bytes at a time, letting the last draw spill into the padding. */
+    for (i = 0;i < count;i += 8) {
+        uint64_t rng = random_u64(state);
+        memcpy(buffer + i, &rng, sizeof(rng));
     }
 
-    lily_return_integer(s, start + rng % (end - start + 1));
+    memcpy(r->state, state, sizeof(state));
+    lily_push_bytestring(s, buffer, (int)count);
+    lily_free(buffer);
+    lily_return_top(s);
 }
 
 void lily_random_Random_double(lily_state *s)
@@ -110,4 +179,89 @@ void lily_random_Random_double_between(lily_state *s)
     lily_return_double(s, start + rng * (end - start));
 }
 
+void lily_random_Random_doubles(lily_state *s)
+{
+    lily_random_Random *r = ARG_Random(s, 0);
+    uint32_t count = count_arg(s, 1);
+    lily_container_val *result = lily_push_list(s, count);
+    uint32_t i;
+
+    for (i = 0;i < count;i++) {
+        lily_push_double(s, random_double(r->state));
+        lily_con_set_from_stack(s, result, i);
+    }
+
+    lily_return_top(s);
+}
+
+void lily_random_Random_integers(lily_state *s)
+{
+    lily_random_Random *r = ARG_Random(s, 0);
+    uint32_t count = count_arg(s, 1);
+    int64_t start = lily_arg_integer(s, 2);
+    int64_t end = lily_arg_integer(s, 3);
+
+    if (start > end)
+        lily_ValueError(s, "Interval range is reversed.");
+
+    lily_container_val *result = lily_push_list(s, count);
+    uint32_t i;
+
+    for (i = 0;i < count;i++) {
+        lily_push_integer(s, random_between(r->state, start, end));
+        lily_con_set_from_stack(s, result, i);
+    }
+
+    lily_return_top(s);
+}
+
+void lily_random_Random_jump(lily_state *s)
+{
+    static const uint64_t table[] = {
+        0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+        0xa9582618e03fc9aa, 0x39abdc4529b1661c
+    };
+
+    lily_random_Random *r = ARG_Random(s, 0);
+
+    random_jump(r->state, table);
+    lily_return_unit(s);
+}
+
+void lily_random_Random_long_jump(lily_state *s)
+{
+    static const uint64_t table[] = {
+        0x76e15d3efefdcbbf, 0xc5004e441c522fb3,
+        0x77710069854ee241, 0x39109bb02acbe635
+    };
+
+    lily_random_Random *r = ARG_Random(s, 0);
+
+    random_jump(r->state, table);
+    lily_return_unit(s);
+}
+
+void lily_random_Random_shuffle(lily_state *s)
+{
+    lily_random_Random *r = ARG_Random(s, 0);
+    lily_container_val *con = lily_arg_container(s, 1);
+    uint32_t i = lily_con_size(con);
+
+    /* Fisher-Yates, walking down from the end. */
+    while (i > 1) {
+        uint32_t j = (uint32_t)(random_u64(r->state) % i);
+
+        i--;
+
+        if (i == j)
+            continue;
+
+        lily_push_value(s, lily_con_get(con, i));
+        lily_con_set(con, i, lily_con_get(con, j));
+        lily_con_set_from_stack(s, con, j);
+    }
+
+    lily_return_unit(s);
+}
+
 LILY_DECLARE_RANDOM_CALL_TABLE
@@ -20,11 +20,17 @@ lily_cid_at(s_, 0)
 LILY_RANDOM_EXPORT
 const char *lily_random_info_table[] = {
     "\1Random\0"
-    ,"C\4Random\0"
+    ,"C\12Random\0"
     ,"m\0<new>\0(*Integer): Random"
     ,"m\0between\0(Random,Integer,Integer): Integer"
+    ,"m\0bytes\0(Random,Integer): ByteString"
     ,"m\0double\0(Random): Double"
     ,"m\0double_between\0(Random,Double,Double): Double"
+    ,"m\0doubles\0(Random,Integer): List[Double]"
+    ,"m\0integers\0(Random,Integer,Integer,Integer): List[Integer]"
+    ,"m\0jump\0(Random)"
+    ,"m\0long_jump\0(Random)"
+    ,"m\0shuffle\0[A](Random,List[A])"
     ,"Z"
 };
 #define LILY_DECLARE_RANDOM_CALL_TABLE \
@@ -34,7 +40,13 @@ lily_call_entry_func lily_random_call_table[] = { \
     NULL, \
     lily_random_new_Random, \
     lily_random_Random_between, \
+    lily_random_Random_bytes, \
     lily_random_Random_double, \
     lily_random_Random_double_between, \
+    lily_random_Random_doubles, \
+    lily_random_Random_integers, \
+    lily_random_Random_jump, \
+    lily_random_Random_long_jump, \
+    lily_random_Random_shuffle, \
 };
 #endif
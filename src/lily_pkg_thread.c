@@ -0,0 +1,900 @@
+#include <ctype.h>
+#include <string.h>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+#include "lily.h"
+#include "lily_alloc.h"
+#include "lily_import.h"
+#include "lily_parser.h"
+#include "lily_platform.h"
+#include "lily_value.h"
+#include "lily_vm.h"
+#define LILY_NO_EXPORT
+#include "lily_pkg_thread_bindings.h"
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION lily_mutex;
+typedef CONDITION_VARIABLE lily_cond;
+typedef HANDLE lily_thread_handle;
+# define lily_mutex_init(m_)    InitializeCriticalSection(m_)
+# define lily_mutex_destroy(m_) DeleteCriticalSection(m_)
+# define lily_mutex_lock(m_)    EnterCriticalSection(m_)
+# define lily_mutex_unlock(m_)  LeaveCriticalSection(m_)
+# define lily_cond_init(c_)     InitializeConditionVariable(c_)
+# define lily_cond_destroy(c_)
+# define lily_cond_wait(c_, m_) SleepConditionVariableCS(c_, m_, INFINITE)
+# define lily_cond_wake(c_)     WakeAllConditionVariable(c_)
+# define lily_thread_join(t_)   (WaitForSingleObject(t_, INFINITE), \
+                                 CloseHandle(t_))
+# define lily_thread_detach(t_) CloseHandle(t_)
+#else
+typedef pthread_mutex_t lily_mutex;
+typedef pthread_cond_t lily_cond;
+typedef pthread_t lily_thread_handle;
+# define lily_mutex_init(m_)    pthread_mutex_init(m_, NULL)
+# define lily_mutex_destroy(m_) pthread_mutex_destroy(m_)
+# define lily_mutex_lock(m_)    pthread_mutex_lock(m_)
+# define lily_mutex_unlock(m_)  pthread_mutex_unlock(m_)
+# define lily_cond_init(c_)     pthread_cond_init(c_, NULL)
+# define lily_cond_destroy(c_)  pthread_cond_destroy(c_)
+# define lily_cond_wait(c_, m_) pthread_cond_wait(c_, m_)
+# define lily_cond_wake(c_)     pthread_cond_broadcast(c_)
+# define lily_thread_join(t_)   pthread_join(t_, NULL)
+# define lily_thread_detach(t_) pthread_detach(t_)
+#endif
+
+/* Values sent through a Channel are copied into a message that belongs to no
+   interpreter. The receiver builds fresh values out of it. A message is a class
+   id, followed by whatever that class needs. */
+typedef struct lily_thread_message_ {
+    struct lily_thread_message_ *next;
+    uint32_t size;
+    uint32_t pad;
+    char data[];
+} lily_thread_message;
+
+/* This is what Channel values point to. Any number of interpreters can hold a
+   Channel, so it has a lock and a refcount of its own. */
+typedef struct {
+    lily_mutex lock;
+    lily_cond cond;
+    lily_thread_message *first;
+    lily_thread_message *last;
+    uint32_t refcount;
+    uint32_t is_closed;
+} lily_thread_channel;
+
+/* This is shared by a Thread value and the thread that it started. Whichever
+   lets go last frees it. */
+typedef struct {
+    lily_thread_handle handle;
+    lily_mutex lock;
+    uint32_t refcount;
+    uint32_t pad;
+    lily_config config;
+    /* The worker's first module is given this path so that imports start from
+       the same root as the interpreter that made the Thread. */
+    char *context;
+    char *bootcode;
+    char *fn_name;
+    /* These are held until the worker is done. */
+    lily_thread_channel *input;
+    lily_thread_channel *output;
+    /* If the worker fails, this is the error message. NULL otherwise. */
+    char *error;
+} lily_thread_worker;
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    lily_thread_channel *channel;
+} lily_thread_Channel;
+
+typedef struct {
+    LILY_FOREIGN_HEADER
+    lily_thread_worker *worker;
+    uint64_t is_joined;
+} lily_thread_Thread;
+
+static char *copy_string(const char *source)
+{
+    char *result = lily_malloc((strlen(source) + 1) * sizeof(*result));
+
+    strcpy(result, source);
+    return result;
+}
+
+/***
+ *       ____ _                            _
+ *      / ___| |__   __ _ _ __  _ __   ___| |
+ *     | |   | '_ \ / _` | '_ \| '_ \ / _ \ |
+ *     | |___| | | | (_| | | | | | | |  __/ |
+ *      \____|_| |_|\__,_|_| |_|_| |_|\___|_|
+ *
+ */
+
+static void channel_ref(lily_thread_channel *ch)
+{
+    lily_mutex_lock(&ch->lock);
+    ch->refcount++;
+    lily_mutex_unlock(&ch->lock);
+}
+
+static void channel_deref(lily_thread_channel *ch)
+{
+    lily_mutex_lock(&ch->lock);
+    ch->refcount--;
+
+    uint32_t refcount = ch->refcount;
+
+    /* A receiver may be waiting on a holder that has just let go. */
+    lily_cond_wake(&ch->cond);
+    lily_mutex_unlock(&ch->lock);
+
+    if (refcount)
+        return;
+
+    lily_thread_message *message_iter = ch->first;
+
+    while (message_iter) {
+        lily_thread_message *next = message_iter->next;
+
+        lily_free(message_iter);
+        message_iter = next;
+    }
+
+    lily_cond_destroy(&ch->cond);
+    lily_mutex_destroy(&ch->lock);
+    lily_free(ch);
+}
+
+void lily_thread_destroy_Channel(lily_thread_Channel *c)
+{
+    channel_deref(c->channel);
+}
+
+static void push_channel(lily_state *s, uint16_t id, lily_thread_channel *ch)
+{
+    lily_thread_Channel *c = (lily_thread_Channel *)lily_push_foreign(s, id,
+            (lily_destroy_func)lily_thread_destroy_Channel,
+            sizeof(lily_thread_Channel));
+
+    channel_ref(ch);
+    c->channel = ch;
+}
+
+static void encode_raw(lily_msgbuf *msgbuf, const void *source, uint32_t size)
+{
+    lily_mb_add_sized(msgbuf, (const char *)source, (int)size);
+}
+
+static void encode_value(lily_state *s, lily_msgbuf *msgbuf, lily_value *v)
+{
+    uint16_t id = lily_value_class_id(v);
+
+    encode_raw(msgbuf, &id, sizeof(id));
+
+    switch (id) {
+        case LILY_ID_BOOLEAN:
+        case LILY_ID_BYTE:
+        case LILY_ID_INTEGER:
+            encode_raw(msgbuf, &v->value.integer, sizeof(int64_t));
+            break;
+        case LILY_ID_DOUBLE:
+            encode_raw(msgbuf, &v->value.doubleval, sizeof(double));
+            break;
+        case LILY_ID_STRING:
+        case LILY_ID_BYTESTRING: {
+            lily_string_val *sv = v->value.string;
+            uint32_t size = sv->size;
+
+            encode_raw(msgbuf, &size, sizeof(size));
+            encode_raw(msgbuf, sv->string, size);
+            break;
+        }
+        case LILY_ID_UNIT:
+        case LILY_ID_NONE:
+            break;
+        case LILY_ID_SOME:
+        case LILY_ID_FAILURE:
+        case LILY_ID_SUCCESS:
+            encode_value(s, msgbuf, lily_con_get(v->value.container, 0));
+            break;
+        case LILY_ID_LIST:
+        case LILY_ID_TUPLE: {
+            lily_container_val *con = v->value.container;
+            uint32_t i;
+
+            encode_raw(msgbuf, &con->num_values, sizeof(uint32_t));
+
+            for (i = 0;i < con->num_values;i++)
+                encode_value(s, msgbuf, &con->values[i]);
+
+            break;
+        }
+        case LILY_ID_HASH: {
+            lily_hash_val *hash_val = v->value.hash;
+            uint32_t count = (uint32_t)hash_val->num_entries;
+            int i;
+
+            encode_raw(msgbuf, &count, sizeof(count));
+
+            for (i = 0;i < hash_val->num_bins;i++) {
+                lily_hash_entry *entry = hash_val->bins[i];
+
+                while (entry) {
+                    encode_value(s, msgbuf, entry->boxed_key);
+                    encode_value(s, msgbuf, entry->record);
+                    entry = entry->next;
+                }
+            }
+
+            break;
+        }
+        default:
+            lily_ValueError(s, "Cannot send a %s to another thread.",
+                    s->gs->class_table[id]->name);
+    }
+}
+
+static void decode_raw(const char **cursor, void *target, uint32_t size)
+{
+    memcpy(target, *cursor, size);
+    *cursor += size;
+}
+
+static void decode_value(lily_state *s, const char **cursor)
+{
+    uint16_t id;
+    int64_t integer;
+    double doubleval;
+    uint32_t count, i;
+
+    decode_raw(cursor, &id, sizeof(id));
+
+    switch (id) {
+        case LILY_ID_BOOLEAN:
+            decode_raw(cursor, &integer, sizeof(integer));
+            lily_push_boolean(s, (int)integer);
+            break;
+        case LILY_ID_BYTE:
+            decode_raw(cursor, &integer, sizeof(integer));
+            lily_push_byte(s, (uint8_t)integer);
+            break;
+        case LILY_ID_INTEGER:
+            decode_raw(cursor, &integer, sizeof(integer));
+            lily_push_integer(s, integer);
+            break;
+        case LILY_ID_DOUBLE:
+            decode_raw(cursor, &doubleval, sizeof(doubleval));
+            lily_push_double(s, doubleval);
+            break;
+        case LILY_ID_STRING:
+            decode_raw(cursor, &count, sizeof(count));
+            lily_push_string_sized(s, *cursor, (int)count);
+            *cursor += count;
+            break;
+        case LILY_ID_BYTESTRING:
+            decode_raw(cursor, &count, sizeof(count));
+            lily_push_bytestring(s, *cursor, (int)count);
+            *cursor += count;
+            break;
+        case LILY_ID_UNIT:
+            lily_push_unit(s);
+            break;
+        case LILY_ID_NONE:
+            lily_push_empty_variant(s, LILY_ID_NONE);
+            break;
+        case LILY_ID_SOME:
+        case LILY_ID_FAILURE:
+        case LILY_ID_SUCCESS: {
+            lily_container_val *con = lily_push_variant(s, id, 1);
+
+            decode_value(s, cursor);
+            lily_con_set_from_stack(s, con, 0);
+            break;
+        }
+        case LILY_ID_LIST:
+        case LILY_ID_TUPLE: {
+            lily_container_val *con;
+
+            decode_raw(cursor, &count, sizeof(count));
+
+            if (id == LILY_ID_LIST)
+                con = lily_push_list(s, count);
+            else
+                con = lily_push_tuple(s, count);
+
+            for (i = 0;i < count;i++) {
+                decode_value(s, cursor);
+                lily_con_set_from_stack(s, con, i);
+            }
+
+            break;
+        }
+        case LILY_ID_HASH: {
+            decode_raw(cursor, &count, sizeof(count));
+
+            lily_hash_val *hash_val = lily_push_hash(s, (int)count);
+
+            for (i = 0;i < count;i++) {
+                decode_value(s, cursor);
+                decode_value(s, cursor);
+                lily_hash_set_from_stack(s, hash_val);
+            }
+
+            break;
+        }
+    }
+}
+
+void lily_thread_Channel_close(lily_state *s)
+{
+    lily_thread_Channel *c = ARG_Channel(s, 0);
+    lily_thread_channel *ch = c->channel;
+
+    lily_mutex_lock(&ch->lock);
+    ch->is_closed = 1;
+    lily_cond_wake(&ch->cond);
+    lily_mutex_unlock(&ch->lock);
+
+    lily_return_unit(s);
+}
+
+void lily_thread_Channel_new(lily_state *s)
+{
+    lily_thread_Channel *c = INIT_Channel(s);
+    lily_thread_channel *ch = lily_malloc(sizeof(*ch));
+
+    lily_mutex_init(&ch->lock);
+    lily_cond_init(&ch->cond);
+    ch->first = NULL;
+    ch->last = NULL;
+    ch->refcount = 1;
+    ch->is_closed = 0;
+    c->channel = ch;
+
+    lily_return_top(s);
+}
+
+void lily_thread_Channel_receive(lily_state *s)
+{
+    lily_thread_Channel *c = ARG_Channel(s, 0);
+    lily_thread_channel *ch = c->channel;
+
+    lily_mutex_lock(&ch->lock);
+
+    /* Wait for a message, unless nothing else can send one. */
+    while (ch->first == NULL &&
+           ch->is_closed == 0 &&
+           ch->refcount > 1)
+        lily_cond_wait(&ch->cond, &ch->lock);
+
+    lily_thread_message *message = ch->first;
+
+    if (message) {
+        ch->first = message->next;
+
+        if (ch->first == NULL)
+            ch->last = NULL;
+    }
+
+    lily_mutex_unlock(&ch->lock);
+
+    if (message == NULL) {
+        lily_return_none(s);
+        return;
+    }
+
+    const char *cursor = message->data;
+
+    decode_value(s, &cursor);
+    lily_free(message);
+    lily_return_some_of_top(s);
+}
+
+void lily_thread_Channel_send(lily_state *s)
+{
+    lily_thread_Channel *c = ARG_Channel(s, 0);
+    lily_thread_channel *ch = c->channel;
+    lily_msgbuf *msgbuf = lily_msgbuf_get(s);
+
+    encode_value(s, msgbuf, lily_arg_value(s, 1));
+
+    uint32_t size = (uint32_t)lily_mb_pos(msgbuf);
+    lily_thread_message *message = lily_malloc(sizeof(*message) + size);
+
+    memcpy(message->data, lily_mb_raw(msgbuf), size);
+    message->next = NULL;
+    message->size = size;
+
+    lily_mutex_lock(&ch->lock);
+
+    if (ch->is_closed) {
+        lily_mutex_unlock(&ch->lock);
+        lily_free(message);
+        lily_RuntimeError(s, "Cannot send to a closed Channel.");
+    }
+
+    if (ch->last)
+        ch->last->next = message;
+    else
+        ch->first = message;
+
+    ch->last = message;
+    lily_cond_wake(&ch->cond);
+    lily_mutex_unlock(&ch->lock);
+
+    lily_return_unit(s);
+}
+
+/***
+ *      _____ _                        _
+ *     |_   _| |__  _ __ ___  __ _  __| |
+ *       | | | '_ \| '__/ _ \/ _` |/ _` |
+ *       | | | | | | | |  __/ (_| | (_| |
+ *       |_| |_| |_|_|  \___|\__,_|\__,_|
+ *
+ */
+
+static void worker_deref(lily_thread_worker *worker)
+{
+    lily_mutex_lock(&worker->lock);
+    worker->refcount--;
+
+    uint32_t refcount = worker->refcount;
+
+    lily_mutex_unlock(&worker->lock);
+
+    if (refcount)
+        return;
+
+    lily_mutex_destroy(&worker->lock);
+    lily_free(worker->context);
+    lily_free(worker->bootcode);
+    lily_free(worker->fn_name);
+    lily_free(worker->error);
+    lily_free(worker);
+}
+
+void lily_thread_destroy_Thread(lily_thread_Thread *t)
+{
+    /* The worker keeps going, but nothing will wait for it. */
+    if (t->is_joined == 0)
+        lily_thread_detach(t->worker->handle);
+
+    worker_deref(t->worker);
+}
+
+/* The worker's first module imports the target function, so the function's
+   type comes from the same source that the spawning interpreter checked. */
+static void run_worker_call(lily_state *s, lily_thread_worker *worker)
+{
+    lily_parse_state *parser = s->gs->parser;
+    lily_var *var = lily_find_var(parser->main_module, worker->fn_name);
+    lily_raiser *raiser = s->raiser;
+
+    if (var == NULL ||
+        var->item_kind != ITEM_DEFINE ||
+        var->type->subtype_count != 3) {
+        worker->error = copy_string("Thread target could not be loaded.\n");
+        return;
+    }
+
+    lily_function_val *fn = s->gs->readonly_table[var->reg_spot]->value.function;
+    uint16_t channel_id = var->type->subtypes[1]->cls_id;
+
+    /* Like content parsing, this runs on the base jump. If the call raises,
+       the vm comes back to here. */
+    if (setjmp(raiser->all_jumps->jump) == 0) {
+        lily_call_prepare(s, fn);
+        push_channel(s, channel_id, worker->input);
+        push_channel(s, channel_id, worker->output);
+        lily_call(s, 2);
+    }
+    else
+        worker->error = copy_string(lily_error_message(s));
+}
+
+static void run_worker(lily_thread_worker *worker)
+{
+    lily_state *s = lily_new_state(&worker->config);
+
+    if (lily_load_string(s, worker->context, worker->bootcode) &&
+        lily_parse_content(s))
+        run_worker_call(s, worker);
+    else
+        worker->error = copy_string(lily_error_message(s));
+
+    lily_free_state(s);
+
+    /* Let go now, so that receivers on the other side stop waiting. */
+    channel_deref(worker->input);
+    channel_deref(worker->output);
+    worker_deref(worker);
+}
+
+/* par_map splits its input into chunks, and gives each chunk to a thread. */
+typedef struct {
+    lily_thread_handle handle;
+    lily_vm_state *vm;
+    lily_function_val *fn;
+    lily_value *input;
+    lily_value *output;
+    uint32_t count;
+    /* 1 if the chunk is running on a thread of its own, 0 otherwise. */
+    uint16_t is_started;
+    /* 1 if every call succeeded, 0 if one raised. */
+    uint16_t is_ok;
+} lily_thread_chunk;
+
+static void run_chunk(lily_thread_chunk *chunk)
+{
+    chunk->is_ok = (uint16_t)lily_vm_worker_map(chunk->vm, chunk->fn,
+            chunk->input, chunk->output, chunk->count);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_entry(LPVOID arg)
+{
+    run_worker(arg);
+    return 0;
+}
+
+static int start_worker(lily_thread_worker *worker)
+{
+    worker->handle = CreateThread(NULL, 0, worker_entry, worker, 0, NULL);
+    return worker->handle != NULL;
+}
+
+static DWORD WINAPI chunk_entry(LPVOID arg)
+{
+    run_chunk(arg);
+    return 0;
+}
+
+static int start_chunk(lily_thread_chunk *chunk)
+{
+    chunk->handle = CreateThread(NULL, 0, chunk_entry, chunk, 0, NULL);
+    return chunk->handle != NULL;
+}
+
+static uint32_t cpu_count(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (uint32_t)info.dwNumberOfProcessors;
+}
+#else
+static void *worker_entry(void *arg)
+{
+    run_worker(arg);
+    return NULL;
+}
+
+static int start_worker(lily_thread_worker *worker)
+{
+    return pthread_create(&worker->handle, NULL, worker_entry, worker) == 0;
+}
+
+static void *chunk_entry(void *arg)
+{
+    run_chunk(arg);
+    return NULL;
+}
+
+static int start_chunk(lily_thread_chunk *chunk)
+{
+    return pthread_create(&chunk->handle, NULL, chunk_entry, chunk) == 0;
+}
+
+static uint32_t cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count < 1)
+        count = 1;
+
+    return (uint32_t)count;
+}
+#endif
+
+/* The worker's imports start from the directory of the first module. */
+static size_t root_size(lily_module *main_module)
+{
+    const char *slash = strrchr(main_module->path, LILY_PATH_CHAR);
+
+    if (slash == NULL)
+        return 0;
+
+    return (size_t)(slash - main_module->path) + 1;
+}
+
+/* Find the module that 'fn' was declared in, and check that a fresh
+   interpreter could import it and find 'fn' there. */
+static lily_module *module_for_spawn(lily_state *s, lily_function_val *fn)
+{
+    lily_parse_state *parser = s->gs->parser;
+    lily_module *main_module = parser->main_module;
+    lily_module *module_iter = parser->ims->prelude;
+    lily_proto *proto = fn->proto;
+
+    if (fn->code == NULL || fn->upvalues != NULL)
+        lily_ValueError(s, "Thread.spawn needs a define, not a closure.");
+
+    while (module_iter) {
+        if (module_iter->path == proto->module_path)
+            break;
+
+        module_iter = module_iter->next;
+    }
+
+    if (module_iter == main_module)
+        lily_ValueError(s,
+                "Thread.spawn needs a define from an imported module.");
+
+    lily_var *var = NULL;
+    size_t size = root_size(main_module);
+
+    if (module_iter &&
+        module_iter->handle == NULL &&
+        strncmp(module_iter->path, main_module->path, size) == 0)
+        var = lily_find_var(module_iter, proto->name);
+
+    if (var == NULL ||
+        var->item_kind != ITEM_DEFINE ||
+        s->gs->readonly_table[var->reg_spot]->value.function->proto != proto)
+        lily_ValueError(s,
+                "Thread.spawn needs a toplevel define of a local module.");
+
+    return module_iter;
+}
+
+/* Write a module path as an import path. Paths that are more than an
+   identifier need quotes, and the lexer will not take quotes otherwise. */
+static void add_import_path(lily_msgbuf *msgbuf, const char *path, int size)
+{
+    int need_quotes = isdigit((unsigned char)path[0]);
+    int i;
+
+    for (i = 0;i < size;i++) {
+        unsigned char ch = (unsigned char)path[i];
+
+        if (isalnum(ch) == 0 && ch != '_' && ch < 0x80)
+            need_quotes = 1;
+    }
+
+    if (need_quotes)
+        lily_mb_add_char(msgbuf, '"');
+
+    for (i = 0;i < size;i++) {
+        char ch = path[i];
+
+        if (ch == LILY_PATH_CHAR)
+            ch = '/';
+
+        lily_mb_add_char(msgbuf, ch);
+    }
+
+    if (need_quotes)
+        lily_mb_add_char(msgbuf, '"');
+}
+
+void lily_thread_Thread_join(lily_state *s)
+{
+    lily_thread_Thread *t = ARG_Thread(s, 0);
+    lily_thread_worker *worker = t->worker;
+    lily_container_val *variant;
+
+    if (t->is_joined == 0) {
+        lily_thread_join(worker->handle);
+        t->is_joined = 1;
+    }
+
+    if (worker->error) {
+        variant = lily_push_variant(s, LILY_ID_FAILURE, 1);
+        lily_push_string(s, worker->error);
+    }
+    else {
+        variant = lily_push_variant(s, LILY_ID_SUCCESS, 1);
+        lily_push_unit(s);
+    }
+
+    lily_con_set_from_stack(s, variant, 0);
+    lily_return_top(s);
+}
+
+void lily_thread_Thread_spawn(lily_state *s)
+{
+    lily_function_val *fn = lily_arg_function(s, 0);
+    lily_thread_Channel *input = ARG_Channel(s, 1);
+    lily_thread_Channel *output = ARG_Channel(s, 2);
+    lily_module *module = module_for_spawn(s, fn);
+    lily_module *main_module = s->gs->parser->main_module;
+    lily_config *config = lily_config_get(s);
+    lily_thread_worker *worker = lily_malloc(sizeof(*worker));
+
+    /* Embedder hooks and data are not copied, since they may not expect to be
+       called from another thread. */
+    lily_config_init(&worker->config);
+    worker->config.argc = config->argc;
+    worker->config.argv = config->argv;
+    worker->config.gc_start = config->gc_start;
+    worker->config.gc_multiplier = config->gc_multiplier;
+    worker->config.use_sys_dirs = config->use_sys_dirs;
+    worker->config.sys_dirs = config->sys_dirs;
+    memcpy(worker->config.sipkey, config->sipkey, sizeof(config->sipkey));
+
+    /* The module path starts with the root, and ends with the suffix. */
+    const char *target = module->path + root_size(main_module);
+    int target_size = (int)(strlen(target) - strlen(".lily"));
+    lily_msgbuf *msgbuf = lily_msgbuf_get(s);
+
+    lily_mb_add_fmt(msgbuf, "import (%s) ", fn->proto->name);
+    add_import_path(msgbuf, target, target_size);
+    lily_mb_add_char(msgbuf, '\n');
+
+    worker->context = copy_string(main_module->path);
+    worker->bootcode = copy_string(lily_mb_raw(msgbuf));
+    worker->fn_name = copy_string(fn->proto->name);
+    worker->input = input->channel;
+    worker->output = output->channel;
+    worker->error = NULL;
+    /* One for the Thread value, one for the worker. */
+    worker->refcount = 2;
+    lily_mutex_init(&worker->lock);
+    channel_ref(worker->input);
+    channel_ref(worker->output);
+
+    if (start_worker(worker) == 0) {
+        channel_deref(worker->input);
+        channel_deref(worker->output);
+        worker->refcount = 1;
+        worker_deref(worker);
+        lily_RuntimeError(s, "Unable to start a new thread.");
+    }
+
+    lily_thread_Thread *t = INIT_Thread(s);
+
+    t->worker = worker;
+    t->is_joined = 0;
+    lily_return_top(s);
+}
+
+/* Below this many elements per thread, starting a thread costs more than it
+   saves. */
+#define PAR_CHUNK_MIN 1024
+#define PAR_THREAD_MAX 64
+
+static void map_in_order(lily_state *s, lily_container_val *input_list,
+        lily_function_val *fn)
+{
+    uint32_t size = lily_con_size(input_list);
+    uint32_t i;
+
+    lily_call_prepare(s, fn);
+
+    lily_container_val *result = lily_push_list(s, 0);
+
+    lily_list_reserve(result, size);
+
+    for (i = 0;i < size;i++) {
+        lily_push_value(s, lily_con_get(input_list, i));
+        lily_call(s, 1);
+        lily_list_push(result, lily_call_result(s));
+    }
+}
+
+static uint32_t par_thread_count(lily_state *s, uint32_t size)
+{
+    lily_function_val *fn = lily_arg_function(s, 1);
+    uint32_t count;
+
+    if (lily_arg_count(s) == 3) {
+        int64_t threads = lily_arg_integer(s, 2);
+
+        if (threads < 1)
+            lily_ValueError(s, "Thread count must be > 0 (%ld given).",
+                    threads);
+
+        count = threads > PAR_THREAD_MAX ? PAR_THREAD_MAX : (uint32_t)threads;
+    }
+    else
+        count = cpu_count();
+
+    if (fn->is_parallel == 0)
+        count = 1;
+
+    if (count > size / PAR_CHUNK_MIN)
+        count = size / PAR_CHUNK_MIN;
+
+    if (count > PAR_THREAD_MAX)
+        count = PAR_THREAD_MAX;
+
+    return count;
+}
+
+void lily_thread__par_map(lily_state *s)
+{
+    lily_container_val *input_list = lily_arg_container(s, 0);
+    lily_function_val *fn = lily_arg_function(s, 1);
+    uint32_t size = lily_con_size(input_list);
+    uint32_t count = par_thread_count(s, size);
+
+    if (count < 2) {
+        map_in_order(s, input_list, fn);
+        lily_return_top(s);
+        return;
+    }
+
+    lily_container_val *result = lily_push_list(s, size);
+    lily_thread_chunk *chunks = lily_malloc(count * sizeof(*chunks));
+    uint32_t start = 0;
+    uint32_t i;
+
+    for (i = 0;i < count;i++) {
+        lily_thread_chunk *chunk = &chunks[i];
+        uint32_t chunk_size = size / count;
+
+        if (i < size % count)
+            chunk_size++;
+
+        chunk->vm = lily_vm_worker_build(s);
+        chunk->fn = fn;
+        chunk->input = input_list->values + start;
+        chunk->output = result->values + start;
+        chunk->count = chunk_size;
+        chunk->is_started = 0;
+        chunk->is_ok = 0;
+        start += chunk_size;
+    }
+
+    /* This thread takes the first chunk, and any that couldn't start. Call
+       counts are not atomic, so profiled runs keep every chunk here. They
+       still go through the workers, so errors look the same either way. */
+#ifdef LILY_WITH_PROFILE
+    uint32_t thread_stop = 1;
+#else
+    uint32_t thread_stop = count;
+#endif
+
+    for (i = 1;i < thread_stop;i++)
+        chunks[i].is_started = (uint16_t)start_chunk(&chunks[i]);
+
+    for (i = 0;i < count;i++) {
+        if (chunks[i].is_started == 0)
+            run_chunk(&chunks[i]);
+    }
+
+    for (i = 1;i < count;i++) {
+        if (chunks[i].is_started)
+            lily_thread_join(chunks[i].handle);
+    }
+
+    lily_vm_worker_adopt(input_list->values, result->values, size);
+
+    /* Raise what the earliest failing element raised, as map would. */
+    lily_vm_state *failed_vm = NULL;
+
+    for (i = 0;i < count;i++) {
+        if (chunks[i].is_ok == 0 && failed_vm == NULL)
+            failed_vm = chunks[i].vm;
+        else
+            lily_vm_worker_free(chunks[i].vm);
+    }
+
+    lily_free(chunks);
+
+    if (failed_vm)
+        lily_vm_worker_raise(s, failed_vm);
+
+    lily_return_top(s);
+}
+
+LILY_DECLARE_THREAD_CALL_TABLE
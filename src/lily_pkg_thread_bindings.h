@@ -0,0 +1,57 @@
+#ifndef LILY_THREAD_BINDINGS_H
+#define LILY_THREAD_BINDINGS_H
+/* Generated by lily-bindgen, do not edit. */
+
+#if defined(_WIN32) && !defined(LILY_NO_EXPORT)
+#define LILY_THREAD_EXPORT __declspec(dllexport)
+#else
+#define LILY_THREAD_EXPORT
+#endif
+
+#define ARG_Channel(s_, i_) \
+(lily_thread_Channel *)lily_arg_generic(s_, i_)
+#define AS_Channel(v_) \
+(lily_thread_Channel *)lily_as_generic(v_)
+#define ID_Channel(s_) \
+lily_cid_at(s_, 0)
+#define INIT_Channel(s_) \
+(lily_thread_Channel *)lily_push_foreign(s_, ID_Channel(s_), (lily_destroy_func)lily_thread_destroy_Channel, sizeof(lily_thread_Channel))
+
+#define ARG_Thread(s_, i_) \
+(lily_thread_Thread *)lily_arg_generic(s_, i_)
+#define AS_Thread(v_) \
+(lily_thread_Thread *)lily_as_generic(v_)
+#define ID_Thread(s_) \
+lily_cid_at(s_, 1)
+#define INIT_Thread(s_) \
+(lily_thread_Thread *)lily_push_foreign(s_, ID_Thread(s_), (lily_destroy_func)lily_thread_destroy_Thread, sizeof(lily_thread_Thread))
+
+LILY_THREAD_EXPORT
+const char *lily_thread_info_table[] = {
+    "\2Channel\0Thread\0"
+    ,"C\4Channel\0[A]"
+    ,"m\0close\0[A](Channel[A])"
+    ,"m\0new\0[A]: Channel[A]"
+    ,"m\0receive\0[A](Channel[A]): Option[A]"
+    ,"m\0send\0[A](Channel[A],A)"
+    ,"C\2Thread\0"
+    ,"m\0join\0(Thread): Result[String,Unit]"
+    ,"m\0spawn\0[A,B](Function(Channel[A],Channel[B]),Channel[A],Channel[B]): Thread"
+    ,"F\0par_map\0[A,B](List[A],Function(A=>B),:threads *Integer): List[B]"
+    ,"Z"
+};
+#define LILY_DECLARE_THREAD_CALL_TABLE \
+LILY_THREAD_EXPORT \
+lily_call_entry_func lily_thread_call_table[] = { \
+    NULL, \
+    NULL, \
+    lily_thread_Channel_close, \
+    lily_thread_Channel_new, \
+    lily_thread_Channel_receive, \
+    lily_thread_Channel_send, \
+    NULL, \
+    lily_thread_Thread_join, \
+    lily_thread_Thread_spawn, \
+    lily_thread__par_map, \
+};
+#endif
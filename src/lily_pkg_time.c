@@ -1,6 +1,11 @@
 #include <time.h>
 
+#ifdef _WIN32
+# include <windows.h>
+#endif
+
 #include "lily.h"
+#include "lily_platform.h"
 #define LILY_NO_EXPORT
 #include "lily_pkg_time_bindings.h"
 
@@ -19,16 +24,43 @@ void lily_time_Time_clock(lily_state *s)
     lily_return_double(s, ((double)clock())/(double)CLOCKS_PER_SEC);
 }
 
+int64_t lily_time_monotonic_ns(void)
+{
+    int64_t result;
+
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+
+    /* Split the division so that a large count doesn't overflow. */
+    result = (count.QuadPart / frequency.QuadPart) * 1000000000 +
+             (count.QuadPart % frequency.QuadPart) * 1000000000 /
+             frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    result = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+
+    return result;
+}
+
+void lily_time_Time_monotonic_ns(lily_state *s)
+{
+    lily_return_integer(s, lily_time_monotonic_ns());
+}
+
 void lily_time_Time_now(lily_state *s)
 {
     lily_time_Time *t = INIT_Time(s);
 
     time_t raw_time;
-    struct tm *time_info;
 
     time(&raw_time);
-    time_info = localtime(&raw_time);
-    t->local = *time_info;
+    lily_localtime(&raw_time, &t->local);
 
     lily_return_top(s);
 }
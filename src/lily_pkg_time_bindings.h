@@ -20,8 +20,9 @@ lily_cid_at(s_, 0)
 LILY_TIME_EXPORT
 const char *lily_time_info_table[] = {
     "\1Time\0"
-    ,"C\4Time\0"
+    ,"C\5Time\0"
     ,"m\0clock\0: Double"
+    ,"m\0monotonic_ns\0: Integer"
     ,"m\0now\0: Time"
     ,"m\0since_epoch\0(Time): Integer"
     ,"m\0to_s\0(Time): String"
@@ -33,6 +34,7 @@ lily_call_entry_func lily_time_call_table[] = { \
     NULL, \
     NULL, \
     lily_time_Time_clock, \
+    lily_time_Time_monotonic_ns, \
     lily_time_Time_now, \
     lily_time_Time_since_epoch, \
     lily_time_Time_to_s, \
@@ -1,6 +1,8 @@
 #ifndef LILY_PLATFORM_H
 # define LILY_PLATFORM_H
 
+# include <stdint.h>
+
 # ifdef _WIN32
 #  define LILY_PATH_CHAR '\\'
 #  define LILY_PATH_SLASH "\\"
@@ -27,6 +29,20 @@
         strerror_r(errno, _buffer, sizeof(_buffer))
 # endif
 
+/* localtime uses a static buffer, which interpreters on different threads would
+   share. These fill in the caller's struct instead. */
+# ifdef _WIN32
+#  define lily_localtime(_time, _tm) \
+        localtime_s(_tm, _time)
+# else
+#  define lily_localtime(_time, _tm) \
+        localtime_r(_time, _tm)
+# endif
+
+/* Nanoseconds from a clock that never goes backward. This is in the time
+   package, which the bench package shares it with. */
+int64_t lily_time_monotonic_ns(void);
+
 /* LILY_CONFIG_SYS_DIRS_INIT defines the unprocessed default system dirs for
    import hooks to use. Since Windows does not specify a library directory, the
    executable location can be used instead. On Windows, LILY_DIR_PROCESS_CHAR is
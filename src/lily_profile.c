@@ -0,0 +1,578 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lily.h"
+#include "lily_alloc.h"
+#include "lily_code_iter.h"
+#include "lily_emitter.h"
+#include "lily_opcode.h"
+#include "lily_parser.h"
+#include "lily_profile.h"
+#include "lily_vm.h"
+
+/** Profiling builds (cmake with -DWITH_PROFILE=ON) count every opcode that the
+    vm dispatches. The vm keeps one counter per opcode in the global state, and
+    one counter per code position in the proto of each function that runs.
+    Functions also count how many times they were called.
+
+    Code positions are only turned into lines when a report is requested. The
+    emitter writes the line number at the end of every instruction that has
+    one, so code iter can recover them. That keeps the vm's share of the work
+    down to two increments per dispatch.
+
+    Every build has a sampler, which is off unless it's asked for. When it's
+    on, the vm records the stack every time a set number of calls and jumps
+    pass. Every distinct stack is kept once, with a count of how many times it
+    was seen. The result is in the collapsed format that flamegraph tools take
+    as input. When it's off, the vm's only cost is checking a zero countdown at
+    calls and jumps.
+
+    Builds without profiling still have the api, but the report is NULL and
+    only the sampler is reset. **/
+
+/* How many of the hottest lines a report includes. */
+#define REPORT_LINE_LIMIT 20
+
+/* How many buckets the sampler's stack table has. */
+#define SAMPLE_BUCKET_COUNT 256
+
+static const char *opcode_names[] = {
+    [o_assign] = "assign",
+    [o_assign_noref] = "assign_noref",
+    [o_int_add] = "int_add",
+    [o_int_minus] = "int_minus",
+    [o_int_modulo] = "int_modulo",
+    [o_int_multiply] = "int_multiply",
+    [o_int_divide] = "int_divide",
+    [o_int_left_shift] = "int_left_shift",
+    [o_int_right_shift] = "int_right_shift",
+    [o_int_bitwise_and] = "int_bitwise_and",
+    [o_int_bitwise_or] = "int_bitwise_or",
+    [o_int_bitwise_xor] = "int_bitwise_xor",
+    [o_number_add] = "number_add",
+    [o_number_minus] = "number_minus",
+    [o_number_multiply] = "number_multiply",
+    [o_number_divide] = "number_divide",
+    [o_compare_eq] = "compare_eq",
+    [o_compare_not_eq] = "compare_not_eq",
+    [o_compare_greater] = "compare_greater",
+    [o_compare_greater_eq] = "compare_greater_eq",
+    [o_unary_not] = "unary_not",
+    [o_unary_minus] = "unary_minus",
+    [o_unary_bitwise_not] = "unary_bitwise_not",
+    [o_jump] = "jump",
+    [o_jump_if] = "jump_if",
+    [o_jump_if_not_class] = "jump_if_not_class",
+    [o_jump_if_set] = "jump_if_set",
+    [o_for_integer] = "for_integer",
+    [o_for_list_step] = "for_list_step",
+    [o_for_text_step] = "for_text_step",
+    [o_for_setup] = "for_setup",
+    [o_call_foreign] = "call_foreign",
+    [o_call_native] = "call_native",
+    [o_call_register] = "call_register",
+    [o_call_virt] = "call_virt",
+    [o_return_value] = "return_value",
+    [o_return_unit] = "return_unit",
+    [o_build_list] = "build_list",
+    [o_build_tuple] = "build_tuple",
+    [o_build_tuple_local] = "build_tuple_local",
+    [o_build_hash] = "build_hash",
+    [o_build_variant] = "build_variant",
+    [o_list_get] = "list_get",
+    [o_list_set] = "list_set",
+    [o_bytestring_get] = "bytestring_get",
+    [o_bytestring_set] = "bytestring_set",
+    [o_hash_get] = "hash_get",
+    [o_hash_set] = "hash_set",
+    [o_hash_get_literal] = "hash_get_literal",
+    [o_list_get_literal] = "list_get_literal",
+    [o_list_set_literal] = "list_set_literal",
+    [o_global_get] = "global_get",
+    [o_global_set] = "global_set",
+    [o_load_readonly] = "load_readonly",
+    [o_load_integer] = "load_integer",
+    [o_load_boolean] = "load_boolean",
+    [o_load_byte] = "load_byte",
+    [o_load_bytestring_copy] = "load_bytestring_copy",
+    [o_load_empty_variant] = "load_empty_variant",
+    [o_instance_new] = "instance_new",
+    [o_property_get] = "property_get",
+    [o_property_set] = "property_set",
+    [o_virt_get] = "virt_get",
+    [o_traceback_get] = "traceback_get",
+    [o_exception_catch] = "exception_catch",
+    [o_exception_store] = "exception_store",
+    [o_exception_raise] = "exception_raise",
+    [o_closure_get] = "closure_get",
+    [o_closure_set] = "closure_set",
+    [o_closure_new] = "closure_new",
+    [o_closure_function] = "closure_function",
+    [o_double_promotion] = "double_promotion",
+    [o_interpolation] = "interpolation",
+    [o_vm_exit] = "vm_exit",
+};
+
+const char *lily_profile_opcode_name(uint16_t opcode)
+{
+    if (opcode > o_vm_exit)
+        return NULL;
+
+    return opcode_names[opcode];
+}
+
+typedef struct lily_profile_stack_ {
+    char *text;
+    uint64_t count;
+    uint32_t hash;
+    uint32_t pad;
+    struct lily_profile_stack_ *next;
+} lily_profile_stack;
+
+typedef struct lily_profile_samples_ {
+    lily_profile_stack *buckets[SAMPLE_BUCKET_COUNT];
+
+    /* The stack being sampled is built here first. */
+    lily_msgbuf *msgbuf;
+
+    /* Frames being sampled, from the top of the stack down. */
+    lily_call_frame **frames;
+    uint32_t frame_size;
+    uint32_t pad;
+} lily_profile_samples;
+
+static uint32_t hash_stack(const char *text)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*text) {
+        hash ^= (unsigned char)*text;
+        hash *= 16777619u;
+        text++;
+    }
+
+    return hash;
+}
+
+static lily_profile_samples *get_samples(lily_global_state *gs)
+{
+    if (gs->profile_samples == NULL) {
+        lily_profile_samples *samples = lily_malloc(sizeof(*samples));
+
+        memset(samples->buckets, 0, sizeof(samples->buckets));
+        samples->msgbuf = lily_new_msgbuf(64);
+        samples->frame_size = 16;
+        samples->frames = lily_malloc(
+                samples->frame_size * sizeof(*samples->frames));
+        gs->profile_samples = samples;
+    }
+
+    return gs->profile_samples;
+}
+
+static void add_frame(lily_msgbuf *msgbuf, lily_call_frame *frame,
+        uint16_t *code)
+{
+    lily_proto *proto = frame->function->proto;
+
+    /* Foreign functions don't have code, and their frames always hold an
+       instruction to leave the vm. */
+    if (proto->code == NULL) {
+        lily_mb_add_fmt(msgbuf, "%s (%s)", proto->name, proto->module_path);
+        return;
+    }
+
+    uint16_t line;
+
+    if (code) {
+        /* This is the top frame, which is about to run this instruction. */
+        lily_code_iter ci;
+
+        lily_ci_init(&ci, code, 0, 1);
+        lily_ci_next(&ci);
+        line = ci.line_6 ? code[ci.round_total - 1] : 0;
+    }
+    else
+        line = frame->code[-1];
+
+    lily_mb_add_fmt(msgbuf, "%s (%s:%d)", proto->name, proto->module_path,
+            (int)line);
+}
+
+void lily_profile_take_sample(lily_state *s, uint16_t *code)
+{
+    lily_profile_samples *samples = get_samples(s->gs);
+    lily_call_frame *frame = s->call_chain;
+    uint32_t count = 0;
+
+    /* Depth 0 is the toplevel, which isn't a function. */
+    while (frame->depth >= 1) {
+        if (count == samples->frame_size) {
+            samples->frame_size *= 2;
+            samples->frames = lily_realloc(samples->frames,
+                    samples->frame_size * sizeof(*samples->frames));
+        }
+
+        samples->frames[count] = frame;
+        count++;
+        frame = frame->prev;
+    }
+
+    lily_msgbuf *msgbuf = lily_mb_flush(samples->msgbuf);
+    uint32_t i;
+
+    /* Collapsed stacks start from the root. */
+    for (i = count;i > 0;i--) {
+        lily_call_frame *f = samples->frames[i - 1];
+
+        if (i != count)
+            lily_mb_add_char(msgbuf, ';');
+
+        add_frame(msgbuf, f, i == 1 ? code : NULL);
+    }
+
+    const char *text = lily_mb_raw(msgbuf);
+    uint32_t hash = hash_stack(text);
+    lily_profile_stack **bucket =
+            &samples->buckets[hash % SAMPLE_BUCKET_COUNT];
+    lily_profile_stack *iter;
+
+    for (iter = *bucket;iter;iter = iter->next) {
+        if (iter->hash == hash && strcmp(iter->text, text) == 0) {
+            iter->count++;
+            return;
+        }
+    }
+
+    iter = lily_malloc(sizeof(*iter));
+    iter->text = lily_malloc((strlen(text) + 1) * sizeof(*iter->text));
+    strcpy(iter->text, text);
+    iter->count = 1;
+    iter->hash = hash;
+    iter->next = *bucket;
+    *bucket = iter;
+}
+
+static void clear_samples(lily_profile_samples *samples)
+{
+    int i;
+
+    for (i = 0;i < SAMPLE_BUCKET_COUNT;i++) {
+        lily_profile_stack *iter = samples->buckets[i];
+
+        while (iter) {
+            lily_profile_stack *next = iter->next;
+
+            lily_free(iter->text);
+            lily_free(iter);
+            iter = next;
+        }
+
+        samples->buckets[i] = NULL;
+    }
+}
+
+void lily_profile_free_samples(lily_global_state *gs)
+{
+    lily_profile_samples *samples = gs->profile_samples;
+
+    if (samples == NULL)
+        return;
+
+    clear_samples(samples);
+    lily_free_msgbuf(samples->msgbuf);
+    lily_free(samples->frames);
+    lily_free(samples);
+    gs->profile_samples = NULL;
+}
+
+/* Both builds reset the sampler, but only profiling builds have counters. */
+static void reset_samples(lily_state *s)
+{
+    if (s->gs->profile_samples)
+        clear_samples(s->gs->profile_samples);
+
+    s->gs->sample_countdown = s->gs->sample_interval;
+}
+
+void lily_profile_sample_every(lily_state *s, uint32_t count)
+{
+    s->gs->sample_interval = count;
+    s->gs->sample_countdown = count;
+}
+
+const char *lily_profile_collapsed(lily_state *s)
+{
+    lily_profile_samples *samples = get_samples(s->gs);
+    lily_msgbuf *msgbuf = lily_msgbuf_get(s);
+    int i;
+
+    for (i = 0;i < SAMPLE_BUCKET_COUNT;i++) {
+        lily_profile_stack *iter;
+
+        for (iter = samples->buckets[i];iter;iter = iter->next) {
+            char buffer[32];
+
+            snprintf(buffer, sizeof(buffer), " %" PRIu64 "\n", iter->count);
+            lily_mb_add(msgbuf, iter->text);
+            lily_mb_add(msgbuf, buffer);
+        }
+    }
+
+    return lily_mb_raw(msgbuf);
+}
+
+#ifdef LILY_WITH_PROFILE
+
+typedef struct {
+    lily_proto *proto;
+    uint64_t count;
+    /* Calls for function rows, the line for line rows, opcode otherwise. */
+    uint64_t extra;
+} lily_profile_row;
+
+static int row_cmp(const void *a, const void *b)
+{
+    const lily_profile_row *left = a;
+    const lily_profile_row *right = b;
+
+    if (left->count != right->count)
+        return left->count < right->count ? 1 : -1;
+
+    /* Ties are ordered by position for a stable report. */
+    if (left->extra != right->extra)
+        return left->extra < right->extra ? -1 : 1;
+
+    return 0;
+}
+
+static void add_row(lily_msgbuf *msgbuf, uint64_t count, uint64_t extra,
+        int show_extra)
+{
+    char buffer[64];
+
+    if (show_extra)
+        snprintf(buffer, sizeof(buffer), "%14" PRIu64 " %10" PRIu64 "  ",
+                count, extra);
+    else
+        snprintf(buffer, sizeof(buffer), "%14" PRIu64 "  ", count);
+
+    lily_mb_add(msgbuf, buffer);
+}
+
+static uint64_t proto_total(lily_proto *proto)
+{
+    uint64_t total = 0;
+    uint32_t i;
+
+    for (i = 0;i < proto->profile_hits_len;i++)
+        total += proto->profile_hits[i];
+
+    return total;
+}
+
+static void report_opcodes(lily_state *s, lily_msgbuf *msgbuf)
+{
+    uint64_t *counts = s->gs->profile_opcodes;
+    lily_profile_row rows[o_vm_exit + 1];
+    int i, row_count = 0;
+
+    for (i = 0;i <= o_vm_exit;i++) {
+        if (counts[i] == 0)
+            continue;
+
+        rows[row_count].proto = NULL;
+        rows[row_count].count = counts[i];
+        rows[row_count].extra = i;
+        row_count++;
+    }
+
+    qsort(rows, row_count, sizeof(*rows), row_cmp);
+    lily_mb_add(msgbuf, "Opcodes:\n    dispatches  opcode\n");
+
+    for (i = 0;i < row_count;i++) {
+        add_row(msgbuf, rows[i].count, 0, 0);
+        lily_mb_add_fmt(msgbuf, "%s\n", opcode_names[rows[i].extra]);
+    }
+}
+
+static void report_functions(lily_proto_stack *protos, lily_msgbuf *msgbuf)
+{
+    lily_profile_row *rows = lily_malloc(
+            (protos->pos + 1) * sizeof(*rows));
+    uint32_t i, row_count = 0;
+
+    for (i = 0;i < protos->pos;i++) {
+        lily_proto *p = protos->data[i];
+
+        if (p->profile_calls == 0 && p->profile_hits == NULL)
+            continue;
+
+        rows[row_count].proto = p;
+        rows[row_count].count = proto_total(p);
+        rows[row_count].extra = p->profile_calls;
+        row_count++;
+    }
+
+    qsort(rows, row_count, sizeof(*rows), row_cmp);
+    lily_mb_add(msgbuf,
+            "\nFunctions:\n    dispatches      calls  function\n");
+
+    for (i = 0;i < row_count;i++) {
+        lily_proto *p = rows[i].proto;
+
+        add_row(msgbuf, rows[i].count, rows[i].extra, 1);
+
+        if (p->code == NULL)
+            lily_mb_add_fmt(msgbuf, "%s (%s, foreign)\n", p->name,
+                    p->module_path);
+        else
+            lily_mb_add_fmt(msgbuf, "%s (%s)\n", p->name, p->module_path);
+    }
+
+    lily_free(rows);
+}
+
+static int line_row_cmp(const void *a, const void *b)
+{
+    const lily_profile_row *left = a;
+    const lily_profile_row *right = b;
+
+    if (left->proto != right->proto)
+        return left->proto < right->proto ? -1 : 1;
+
+    if (left->extra != right->extra)
+        return left->extra < right->extra ? -1 : 1;
+
+    return 0;
+}
+
+static void report_lines(lily_proto_stack *protos, lily_msgbuf *msgbuf)
+{
+    uint32_t row_count = 0, row_size = 16;
+    lily_profile_row *rows = lily_malloc(row_size * sizeof(*rows));
+    uint32_t i;
+
+    for (i = 0;i < protos->pos;i++) {
+        lily_proto *p = protos->data[i];
+
+        if (p->profile_hits == NULL)
+            continue;
+
+        lily_code_iter ci;
+
+        lily_ci_init(&ci, p->code, 0, (uint16_t)p->profile_hits_len);
+
+        while (lily_ci_next(&ci)) {
+            uint64_t count = p->profile_hits[ci.offset];
+
+            if (count == 0 || ci.line_6 == 0)
+                continue;
+
+            if (row_count == row_size) {
+                row_size *= 2;
+                rows = lily_realloc(rows, row_size * sizeof(*rows));
+            }
+
+            rows[row_count].proto = p;
+            rows[row_count].count = count;
+            rows[row_count].extra =
+                    p->code[ci.offset + ci.round_total - 1];
+            row_count++;
+        }
+    }
+
+    /* Instructions on the same line of the same function are combined. */
+    qsort(rows, row_count, sizeof(*rows), line_row_cmp);
+
+    uint32_t merged = 0;
+
+    for (i = 0;i < row_count;i++) {
+        if (merged &&
+            rows[merged - 1].proto == rows[i].proto &&
+            rows[merged - 1].extra == rows[i].extra)
+            rows[merged - 1].count += rows[i].count;
+        else {
+            rows[merged] = rows[i];
+            merged++;
+        }
+    }
+
+    qsort(rows, merged, sizeof(*rows), row_cmp);
+
+    if (merged > REPORT_LINE_LIMIT)
+        merged = REPORT_LINE_LIMIT;
+
+    lily_mb_add(msgbuf, "\nLines:\n    dispatches  line\n");
+
+    for (i = 0;i < merged;i++) {
+        lily_proto *p = rows[i].proto;
+
+        add_row(msgbuf, rows[i].count, 0, 0);
+        lily_mb_add_fmt(msgbuf, "%s:%d: in %s\n", p->module_path,
+                (int)rows[i].extra, p->name);
+    }
+
+    lily_free(rows);
+}
+
+const char *lily_profile_report(lily_state *s)
+{
+    lily_proto_stack *protos = s->gs->parser->emit->protos;
+    lily_msgbuf *msgbuf = lily_msgbuf_get(s);
+
+    report_opcodes(s, msgbuf);
+    report_functions(protos, msgbuf);
+    report_lines(protos, msgbuf);
+
+    return lily_mb_raw(msgbuf);
+}
+
+uint64_t lily_profile_opcode_count(lily_state *s, uint16_t opcode)
+{
+    return s->gs->profile_opcodes[opcode];
+}
+
+void lily_profile_reset(lily_state *s)
+{
+    lily_proto_stack *protos = s->gs->parser->emit->protos;
+    uint32_t i;
+
+    memset(s->gs->profile_opcodes, 0,
+            (o_vm_exit + 1) * sizeof(*s->gs->profile_opcodes));
+
+    for (i = 0;i < protos->pos;i++) {
+        lily_proto *p = protos->data[i];
+
+        lily_free(p->profile_hits);
+        p->profile_hits = NULL;
+        p->profile_hits_len = 0;
+        p->profile_calls = 0;
+    }
+
+    reset_samples(s);
+}
+
+#else
+
+const char *lily_profile_report(lily_state *s)
+{
+    (void)s;
+    return NULL;
+}
+
+void lily_profile_reset(lily_state *s)
+{
+    reset_samples(s);
+}
+
+uint64_t lily_profile_opcode_count(lily_state *s, uint16_t opcode)
+{
+    (void)s;
+    (void)opcode;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LILY_PROFILE_H
+# define LILY_PROFILE_H
+
+# include <stdint.h>
+
+# include "lily.h"
+
+/* These are for introspect. The public half is in lily.h. */
+
+/* Returns the name of the opcode given, or NULL if there isn't one. */
+const char *lily_profile_opcode_name(uint16_t);
+
+/* Returns how many times an opcode has been dispatched. Always 0 unless the
+   interpreter was built for profiling. */
+uint64_t lily_profile_opcode_count(lily_state *, uint16_t);
+
+struct lily_global_state_;
+
+/* These are for the vm's sampler, which every build has. */
+
+/* Record the stack of the vm, which is about to run the code given. */
+void lily_profile_take_sample(lily_state *, uint16_t *);
+
+/* Free the stacks that the sampler recorded. */
+void lily_profile_free_samples(struct lily_global_state_ *);
+
+#endif
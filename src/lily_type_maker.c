@@ -4,7 +4,7 @@
 #include "lily_alloc.h"
 #include "lily_type_maker.h"
 
-extern lily_type *lily_question_type;
+extern lily_type *const lily_question_type;
 
 /* These are the TYPE_* flags that bubble up through types (it's written onto a
    type if any subtypes have them). */
@@ -7,10 +7,10 @@
 #include "lily_alloc.h"
 #include "lily_type_system.h"
 
-extern lily_class *lily_self_class;
-extern lily_type *lily_scoop_type;
-extern lily_type *lily_question_type;
-extern lily_type *lily_unit_type;
+extern lily_class *const lily_self_class;
+extern lily_type *const lily_scoop_type;
+extern lily_type *const lily_question_type;
+extern lily_type *const lily_unit_type;
 
 # define ENSURE_TYPE_STACK(new_size) \
 if (new_size >= ts->max) \
@@ -90,14 +90,15 @@ typedef struct lily_bytestring_val_ {
 
 /* This serves List, Tuple, class instances, and (non-empty) variants. All they
    need is some container that holds N number of inner values. Some of them will
-   make use of the gc_entry, but others won't. */
+   make use of the gc_entry, but others won't. The values are held directly in
+   one array, so growing a List moves them. */
 typedef struct lily_container_val_ {
     uint32_t refcount;
     uint16_t class_id;
     uint16_t instance_ctor_need;
     uint32_t num_values;
     uint32_t extra_space;
-    struct lily_value_ **values;
+    struct lily_value_ *values;
     struct lily_gc_entry_ *gc_entry;
 } lily_container_val;
 
@@ -107,7 +108,7 @@ typedef struct lily_vt_container_val_ {
     uint16_t instance_ctor_need;
     uint32_t num_values;
     uint32_t extra_space;
-    struct lily_value_ **values;
+    struct lily_value_ *values;
     struct lily_gc_entry_ *gc_entry;
     struct lily_function_val_ **virts;
 } lily_vt_container_val;
@@ -150,9 +151,16 @@ typedef struct lily_file_val_ {
    arguments to a function themselves. */
 typedef struct lily_function_val_ {
     uint32_t refcount;
-    uint32_t pad1;
+    uint16_t pad1;
 
-    uint16_t pad2;
+    /* Foreign functions only. 1 if several threads can call the function at
+       once, 0 otherwise. Workers lend arguments to these without a ref, so the
+       function may return its argument, but not keep it or return a value from
+       inside of it. */
+    uint16_t is_parallel;
+
+    /* Native functions only. 1 if the proto has a catch table, 0 otherwise. */
+    uint16_t has_catch;
 
     uint16_t code_len;
 
@@ -271,11 +279,17 @@ typedef struct lily_generic_gc_val_ {
 
 lily_bytestring_val *lily_new_bytestring_raw(const char *, int);
 lily_container_val *lily_new_container_raw(uint16_t, uint32_t);
+lily_container_val *lily_new_variant_raw(uint16_t, uint32_t);
 lily_vt_container_val *lily_new_vt_container_raw(uint16_t, uint32_t,
         lily_function_val **);
 lily_hash_val *lily_new_hash_raw(int);
 lily_string_val *lily_new_string_raw(const char *);
 
+/* The hash that a String key would have. This lets a key that is known ahead of
+   time be hashed once, and given to lily_hash_get_with_hash. */
+uint64_t lily_hash_for_string(const char *, lily_string_val *);
+lily_value *lily_hash_get_with_hash(lily_hash_val *, lily_value *, uint64_t);
+
 void lily_deref(lily_value *);
 void lily_push_coroutine(struct lily_vm_state_ *, lily_coroutine_val *);
 void lily_push_file(struct lily_vm_state_ *, FILE *, const char *,
@@ -6,10 +6,11 @@
 #include "lily_alloc.h"
 #include "lily_opcode.h"
 #include "lily_parser.h"
+#include "lily_profile.h"
 #include "lily_value.h"
 #include "lily_vm.h"
 
-extern lily_gc_entry *lily_gc_stopper;
+extern lily_gc_entry *const lily_gc_stopper;
 
 /* Same here: Safely escape string values for `KeyError`. */
 void lily_mb_escape_add_str(lily_msgbuf *, const char *);
@@ -27,6 +28,22 @@ current_frame->code = code + to_add
 
 #define INITIAL_REGISTER_COUNT 16
 
+/* The sampler (see lily_profile.c) counts down at calls and jumps. Every loop
+   jumps each time around, so code can't run long without reaching one. This
+   keeps the check out of the path of other opcodes. */
+#define SAMPLE_POINT \
+if (vm->gs->sample_countdown && --vm->gs->sample_countdown == 0) \
+    sample_point(vm, code)
+
+/* Profiling builds count calls and dispatches (see lily_profile.c). */
+#ifdef LILY_WITH_PROFILE
+# define PROFILE_CALL(f) f->proto->profile_calls++
+# define PROFILE_DISPATCH profile_dispatch(vm, current_frame, code)
+#else
+# define PROFILE_CALL(f)
+# define PROFILE_DISPATCH
+#endif
+
 /***
  *      ____       _
  *     / ___|  ___| |_ _   _ _ __
@@ -67,6 +84,7 @@ static lily_vm_state *new_vm_state(lily_raiser *raiser, int count)
     toplevel_frame->top = register_base;
     toplevel_frame->register_end = register_end;
     toplevel_frame->code = NULL;
+    toplevel_frame->jump = NULL;
     toplevel_frame->return_target = NULL;
     toplevel_frame->depth = 0;
     toplevel_frame->prev = NULL;
@@ -76,6 +94,7 @@ static lily_vm_state *new_vm_state(lily_raiser *raiser, int count)
     first_frame->register_end = register_end;
     first_frame->code = NULL;
     first_frame->function = NULL;
+    first_frame->jump = NULL;
     first_frame->return_target = register_base[0];
     first_frame->depth = 1;
     first_frame->prev = toplevel_frame;
@@ -111,9 +130,23 @@ lily_vm_state *lily_new_vm_state(lily_raiser *raiser)
     gs->gc_live_entries = NULL;
     gs->gc_spare_entries = NULL;
     gs->gc_live_entry_count = 0;
+    gs->gc_sweep_count = 0;
+    gs->gc_tag_count = 0;
     gs->stdout_reg_spot = UINT16_MAX;
+    gs->intern_literal_pos = 0;
+    gs->intern_table = NULL;
+    gs->profile_samples = NULL;
+    gs->sample_interval = 0;
+    gs->sample_countdown = 0;
     gs->first_vm = vm;
 
+#ifdef LILY_WITH_PROFILE
+    gs->profile_opcodes = lily_malloc(
+            (o_vm_exit + 1) * sizeof(*gs->profile_opcodes));
+    memset(gs->profile_opcodes, 0,
+            (o_vm_exit + 1) * sizeof(*gs->profile_opcodes));
+#endif
+
     vm->gs = gs;
 
     return vm;
@@ -236,7 +269,19 @@ void lily_free_vm(lily_vm_state *vm)
 
     destroy_gc_entries(vm);
 
+    if (vm->gs->intern_table) {
+        lily_value v;
+
+        v.flags = LILY_ID_HASH | VAL_IS_DEREFABLE;
+        v.value.hash = vm->gs->intern_table;
+        lily_value_destroy(&v);
+    }
+
     lily_free(vm->gs->class_table);
+    lily_profile_free_samples(vm->gs);
+#ifdef LILY_WITH_PROFILE
+    lily_free(vm->gs->profile_opcodes);
+#endif
     lily_free(vm->gs);
     lily_free(vm);
 }
@@ -348,6 +393,7 @@ static void invoke_gc(lily_vm_state *vm)
     vm->gs->gc_live_entry_count = i;
     vm->gs->gc_live_entries = new_live_entries;
     vm->gs->gc_spare_entries = new_spare_entries;
+    vm->gs->gc_sweep_count++;
 }
 
 static void list_marker(lily_value *v)
@@ -365,7 +411,7 @@ static void list_marker(lily_value *v)
     uint32_t i;
 
     for (i = 0;i < list_val->num_values;i++) {
-        lily_value *elem = list_val->values[i];
+        lily_value *elem = &list_val->values[i];
 
         if (elem->flags & VAL_HAS_SWEEP_FLAG)
             gc_mark(elem);
@@ -502,6 +548,7 @@ void lily_value_tag(lily_vm_state *vm, lily_value *v)
     /* Attach the gc_entry to the value so the caller doesn't have to. */
     v->value.gc_generic->gc_entry = new_entry;
     gs->gc_live_entry_count++;
+    gs->gc_tag_count++;
 
     v->flags |= VAL_IS_GC_TAGGED;
 }
@@ -623,6 +670,15 @@ static void prep_registers(lily_call_frame *frame, uint16_t *code)
     }
 }
 
+static void move_bytestring(lily_value *v, lily_bytestring_val *z)
+{
+    if (v->flags & VAL_IS_DEREFABLE)
+        lily_deref(v);
+
+    v->value.string = (lily_string_val *)z;
+    v->flags = LILY_ID_BYTESTRING | V_BYTESTRING_FLAG | VAL_IS_DEREFABLE;
+}
+
 static void move_byte(lily_value *v, uint8_t z)
 {
     if (v->flags & VAL_IS_DEREFABLE)
@@ -719,6 +775,7 @@ static void add_call_frame(lily_vm_state *vm)
 
     new_frame->prev = vm->call_chain;
     new_frame->next = NULL;
+    new_frame->jump = NULL;
     new_frame->return_target = NULL;
     /* The toplevel and __main__ frames are allocated directly, so there's
        always a next and a register end set. */
@@ -910,117 +967,75 @@ static void do_o_property_set(lily_vm_state *vm, uint16_t *code)
     lily_container_val *ival = vm_regs[code[2]]->value.container;
     lily_value *rhs_reg = vm_regs[code[3]];
 
-    lily_value_assign(ival->values[index], rhs_reg);
+    lily_value_assign(&ival->values[index], rhs_reg);
 }
 
-static void do_o_property_get(lily_vm_state *vm, uint16_t *code)
+/* The subscript opcodes check for an index that is in range with one compare,
+   so they come here for anything else. Negative indexes count back from the
+   end. If the index is out of range, IndexError is raised. */
+static int64_t fix_index(lily_vm_state *vm, int64_t index, uint32_t size)
 {
-    lily_value **vm_regs = vm->call_chain->start;
-    uint16_t index = code[1];
-    lily_container_val *ival = vm_regs[code[2]]->value.container;
-    lily_value *result_reg = vm_regs[code[3]];
+    if (index < 0 && index + size >= 0)
+        return index + size;
 
-    lily_value_assign(result_reg, ival->values[index]);
+    boundary_error(vm, index);
+    return 0;
 }
 
-static void do_o_virt_get(lily_vm_state *vm, uint16_t *code)
+static void do_o_hash_get(lily_vm_state *vm, uint16_t *code)
 {
     lily_value **vm_regs = vm->call_chain->start;
-    uint16_t index = code[1];
-    lily_vt_container_val *ival = vm_regs[code[2]]->value.vt_container;
-    lily_value *result_reg = vm_regs[code[3]];
-    lily_function_val *virt = ival->virts[index];
+    lily_value *key_reg = vm_regs[code[2]];
+    lily_value *elem = lily_hash_get(vm, vm_regs[code[1]]->value.hash,
+            key_reg);
 
-    move_function_f(0, result_reg, virt);
+    if (elem == NULL)
+        key_error(vm, key_reg);
 
-    /* This is not a closure copy, ergo it is not derefable. */
-    result_reg->flags &= ~VAL_IS_DEREFABLE;
+    lily_value_assign(vm_regs[code[3]], elem);
 }
 
-#define RELATIVE_INDEX(limit) \
-    if (index_int < 0) { \
-        int64_t new_index = limit + index_int; \
-        if (new_index < 0) \
-            boundary_error(vm, index_int); \
- \
-        index_int = new_index; \
-    } \
-    else if (index_int >= limit) \
-        boundary_error(vm, index_int);
-
-/* This handles subscript assignment. The index is a register, and needs to be
-   validated. */
-static void do_o_subscript_set(lily_vm_state *vm, uint16_t *code)
+static void do_o_hash_get_literal(lily_vm_state *vm, uint16_t *code)
 {
     lily_value **vm_regs = vm->call_chain->start;
-    lily_value *lhs_reg, *index_reg, *rhs_reg;
-    uint16_t base;
-
-    lhs_reg = vm_regs[code[1]];
-    index_reg = vm_regs[code[2]];
-    rhs_reg = vm_regs[code[3]];
-    base = FLAGS_TO_BASE(lhs_reg);
+    lily_value *key = vm->gs->readonly_table[code[1]];
+    uint64_t hash = (uint64_t)code[2] |
+                    (uint64_t)code[3] << 16 |
+                    (uint64_t)code[4] << 32 |
+                    (uint64_t)code[5] << 48;
+    lily_value *elem = lily_hash_get_with_hash(vm_regs[code[6]]->value.hash,
+            key, hash);
 
-    if (base != LILY_ID_HASH) {
-        int64_t index_int = index_reg->value.integer;
+    if (elem == NULL)
+        key_error(vm, key);
 
-        if (base == LILY_ID_BYTESTRING) {
-            lily_string_val *bytev = lhs_reg->value.string;
-            RELATIVE_INDEX(bytev->size)
-            bytev->string[index_int] = (char)rhs_reg->value.integer;
-        }
-        else {
-            /* List and Tuple have the same internal representation. */
-            lily_container_val *list_val = lhs_reg->value.container;
-            RELATIVE_INDEX(list_val->num_values)
-            lily_value_assign(list_val->values[index_int], rhs_reg);
-        }
-    }
-    else
-        lily_hash_set(vm, lhs_reg->value.hash, index_reg, rhs_reg);
+    lily_value_assign(vm_regs[code[7]], elem);
 }
 
-/* This handles subscript access. The index is a register, and needs to be
-   validated. */
-static void do_o_subscript_get(lily_vm_state *vm, uint16_t *code)
+static void do_o_property_get(lily_vm_state *vm, uint16_t *code)
 {
     lily_value **vm_regs = vm->call_chain->start;
-    lily_value *lhs_reg, *index_reg, *result_reg;
-    uint16_t base;
-
-    lhs_reg = vm_regs[code[1]];
-    index_reg = vm_regs[code[2]];
-    result_reg = vm_regs[code[3]];
-    base = FLAGS_TO_BASE(lhs_reg);
+    uint16_t index = code[1];
+    lily_container_val *ival = vm_regs[code[2]]->value.container;
+    lily_value *result_reg = vm_regs[code[3]];
 
-    if (base != LILY_ID_HASH) {
-        int64_t index_int = index_reg->value.integer;
+    lily_value_assign(result_reg, &ival->values[index]);
+}
 
-        if (lhs_reg->flags & (V_BYTESTRING_FLAG | V_STRING_FLAG)) {
-            lily_string_val *bytev = lhs_reg->value.string;
-            RELATIVE_INDEX(bytev->size)
-            move_byte(result_reg, (uint8_t) bytev->string[index_int]);
-        }
-        else {
-            /* List and Tuple have the same internal representation. */
-            lily_container_val *list_val = lhs_reg->value.container;
-            RELATIVE_INDEX(list_val->num_values)
-            lily_value_assign(result_reg, list_val->values[index_int]);
-        }
-    }
-    else {
-        lily_value *elem = lily_hash_get(vm, lhs_reg->value.hash, index_reg);
+static void do_o_virt_get(lily_vm_state *vm, uint16_t *code)
+{
+    lily_value **vm_regs = vm->call_chain->start;
+    uint16_t index = code[1];
+    lily_vt_container_val *ival = vm_regs[code[2]]->value.vt_container;
+    lily_value *result_reg = vm_regs[code[3]];
+    lily_function_val *virt = ival->virts[index];
 
-        /* Give up if the key doesn't exist. */
-        if (elem == NULL)
-            key_error(vm, index_reg);
+    move_function_f(0, result_reg, virt);
 
-        lily_value_assign(result_reg, elem);
-    }
+    /* This is not a closure copy, ergo it is not derefable. */
+    result_reg->flags &= ~VAL_IS_DEREFABLE;
 }
 
-#undef RELATIVE_INDEX
-
 static void do_o_build_hash(lily_vm_state *vm, uint16_t *code)
 {
     lily_value **vm_regs = vm->call_chain->start;
@@ -1057,12 +1072,12 @@ static void do_o_build_list_tuple(lily_vm_state *vm, uint16_t *code)
     else
         lv = lily_new_container_raw(LILY_ID_TUPLE, count);
 
-    lily_value **elems = lv->values;
+    lily_value *elems = lv->values;
     uint16_t i;
 
     for (i = 0;i < count;i++) {
         lily_value *rhs_reg = vm_regs[code[2+i]];
-        lily_value_assign(elems[i], rhs_reg);
+        lily_value_assign(&elems[i], rhs_reg);
     }
 
     if (code[0] == o_build_list)
@@ -1071,21 +1086,49 @@ static void do_o_build_list_tuple(lily_vm_state *vm, uint16_t *code)
         move_tuple_f(VAL_IS_GC_SPECULATIVE, result, lv);
 }
 
+/* The optimizer only sends Tuples here that can't leave their register. If
+   nothing else holds the last one built, it's filled again instead of being
+   freed and made over. prep_registers clears registers when a call starts, so
+   this only reuses a Tuple built earlier in the same frame (such as on the last
+   pass through a loop). */
+static void do_o_build_tuple_local(lily_vm_state *vm, uint16_t *code)
+{
+    lily_value **vm_regs = vm->call_chain->start;
+    uint16_t count = code[1];
+    lily_value *result = vm_regs[code[2+count]];
+    lily_container_val *tv = result->value.container;
+
+    if (FLAGS_TO_BASE(result) != LILY_ID_TUPLE ||
+        tv->refcount != 1 ||
+        tv->num_values != count) {
+        do_o_build_list_tuple(vm, code);
+        return;
+    }
+
+    lily_value *elems = tv->values;
+    uint16_t i;
+
+    for (i = 0;i < count;i++) {
+        lily_value *rhs_reg = vm_regs[code[2+i]];
+        lily_value_assign(&elems[i], rhs_reg);
+    }
+}
+
 static void do_o_build_variant(lily_vm_state *vm, uint16_t *code)
 {
     lily_value **vm_regs = vm->call_chain->start;
     uint16_t variant_id = code[1];
     uint16_t count = code[2];
     lily_value *result = vm_regs[code[count + 3]];
-    lily_container_val *ival = lily_new_container_raw(variant_id, count);
-    lily_value **slots = ival->values;
+    lily_container_val *ival = lily_new_variant_raw(variant_id, count);
+    lily_value *slots = ival->values;
     uint16_t i;
     uint32_t inner_flags = 0;
 
     for (i = 0;i < count;i++) {
         lily_value *rhs_reg = vm_regs[code[3+i]];
 
-        lily_value_assign(slots[i], rhs_reg);
+        lily_value_assign(&slots[i], rhs_reg);
         inner_flags |= rhs_reg->flags & VAL_HAS_SWEEP_FLAG;
     }
 
@@ -1112,7 +1155,7 @@ static void do_o_exception_raise(lily_vm_state *vm, lily_value *exception_val)
        container for traceback. */
 
     lily_container_val *ival = exception_val->value.container;
-    char *message = ival->values[0]->value.string->string;
+    char *message = ival->values[0].value.string->string;
     lily_class *raise_cls = vm->gs->class_table[ival->class_id];
 
     /* There's no need for a ref/deref here, because the gc cannot trigger
@@ -1365,7 +1408,38 @@ static void do_o_closure_function(lily_vm_state *vm, uint16_t *code)
 
     Actually capturing exceptions is a little rough though. The interpreter
     currently allows raising a code that the vm's exception capture later has to
-    possibly dynaload (eww). **/
+    possibly dynaload (eww).
+
+    Most handlers never look at the traceback of what they catch. Instead of
+    making a String for every frame, exception capture saves the proto and line
+    of each frame into a ByteString. The traceback property is given an empty
+    List, so that it's always a List[String] to foreign code. The ByteString and
+    that empty List are held in two hidden slots after the properties of the
+    exception (counted by extra_space, which instances don't otherwise use).
+    The emitter writes o_traceback_get for reads of the traceback. If the
+    traceback is still the empty List from capture, that opcode builds the real
+    traceback from the frames. Either way, the hidden slots are cleared. **/
+
+/* A frame of a traceback that hasn't been built yet. */
+typedef struct {
+    lily_proto *proto;
+    uint64_t line;
+} lily_traceback_frame;
+
+static const char *traceback_line(lily_msgbuf *msgbuf, lily_proto *proto,
+        uint16_t line)
+{
+    const char *str;
+
+    if (proto->code == NULL)
+        str = lily_mb_sprintf(msgbuf, "%s: in %s", proto->module_path,
+                proto->name);
+    else
+        str = lily_mb_sprintf(msgbuf, "%s:%d: in %s", proto->module_path,
+                line, proto->name);
+
+    return str;
+}
 
 /* This builds the current exception traceback into a raw list value. It is up
    to the caller to move the raw list to somewhere useful. */
@@ -1385,16 +1459,62 @@ static lily_container_val *build_traceback_raw(lily_vm_state *vm)
          i >= 1;
          i--, frame_iter = frame_iter->prev) {
         lily_proto *proto = frame_iter->function->proto;
-        const char *str;
+        uint16_t line = proto->code ? frame_iter->code[-1] : 0;
+        const char *str = traceback_line(msgbuf, proto, line);
+
+        move_string(&lv->values[i - 1], lily_new_string_raw(str));
+    }
+
+    return lv;
+}
+
+/* This saves the frames of the current traceback into a ByteString, most
+   recent frame last. */
+static lily_bytestring_val *capture_traceback_raw(lily_vm_state *vm)
+{
+    lily_call_frame *frame_iter = vm->call_chain;
+    int depth = frame_iter->depth;
+    uint32_t size = depth * sizeof(lily_traceback_frame);
+    /* This is laid out like the ByteString values that lily_api.c makes, with
+       the buffer in the same block. */
+    lily_bytestring_val *bv = lily_malloc(sizeof(*bv) + size + 1);
+    lily_traceback_frame *frames = (lily_traceback_frame *)(bv + 1);
+    int i;
+
+    for (i = depth;
+         i >= 1;
+         i--, frame_iter = frame_iter->prev) {
+        lily_proto *proto = frame_iter->function->proto;
+
+        frames[i - 1].proto = proto;
+        frames[i - 1].line = proto->code ? frame_iter->code[-1] : 0;
+    }
 
-        if (proto->code == NULL)
-            str = lily_mb_sprintf(msgbuf, "%s: in %s", proto->module_path,
-                    proto->name);
-        else
-            str = lily_mb_sprintf(msgbuf, "%s:%d: in %s", proto->module_path,
-                    frame_iter->code[-1], proto->name);
+    /* ByteString buffers have a terminator, even if it's never used. */
+    ((char *)frames)[size] = '\0';
 
-        move_string(lv->values[i - 1], lily_new_string_raw(str));
+    bv->refcount = 1;
+    bv->string = (char *)frames;
+    bv->size = size;
+    return bv;
+}
+
+/* Build the traceback that a ByteString from capture_traceback_raw holds. */
+static lily_container_val *render_traceback_raw(lily_vm_state *vm,
+        lily_bytestring_val *bv)
+{
+    lily_traceback_frame *frames = (lily_traceback_frame *)bv->string;
+    uint32_t count = bv->size / sizeof(*frames);
+    uint32_t i;
+
+    lily_msgbuf *msgbuf = lily_msgbuf_get(vm);
+    lily_container_val *lv = lily_new_container_raw(LILY_ID_LIST, count);
+
+    for (i = 0;i < count;i++) {
+        const char *str = traceback_line(msgbuf, frames[i].proto,
+                (uint16_t)frames[i].line);
+
+        move_string(&lv->values[i], lily_new_string_raw(str));
     }
 
     return lv;
@@ -1424,17 +1544,60 @@ static void store_exception_into(lily_vm_state *vm, lily_value *result)
         ival = lily_new_container_raw(cls->id, 2);
 
         move_instance_f(cls->id, result, ival);
-        move_string(ival->values[0], sv);
+        move_string(&ival->values[0], sv);
     }
 
-    move_list_f(0, ival->values[1], build_traceback_raw(vm));
+    if (ival->extra_space == 0) {
+        uint32_t count = ival->num_values;
+
+        ival->values = lily_realloc(ival->values,
+                (count + 2) * sizeof(*ival->values));
+        ival->values[count].flags = 0;
+        ival->values[count + 1].flags = 0;
+        ival->extra_space = 2;
+    }
+
+    lily_value *hidden = ival->values + ival->num_values;
+    lily_container_val *lv = lily_new_container_raw(LILY_ID_LIST, 0);
+
+    move_bytestring(&hidden[0], capture_traceback_raw(vm));
+    move_list_f(0, &hidden[1], lv);
+    lily_value_assign(&ival->values[1], &hidden[1]);
 }
 
-static void restore_from_exception(lily_vm_state *vm,
-        lily_vm_catch_entry *entry, uint16_t *code)
+static void do_o_traceback_get(lily_vm_state *vm, uint16_t *code)
 {
-    lily_call_frame *frame = entry->call_frame;
+    lily_value **vm_regs = vm->call_chain->start;
+    lily_container_val *ival = vm_regs[code[2]]->value.container;
+    lily_value *traceback = &ival->values[1];
+    lily_value *result_reg = vm_regs[code[3]];
+
+    /* Frames are pending until the first time the traceback is read. They're
+       only built if the traceback hasn't been replaced since capture. */
+    if (ival->extra_space) {
+        lily_value *hidden = ival->values + ival->num_values;
+
+        if (hidden[1].value.container == traceback->value.container) {
+            lily_bytestring_val *bv =
+                    (lily_bytestring_val *)hidden[0].value.string;
+            lily_container_val *lv = render_traceback_raw(vm, bv);
 
+            move_list_f(0, traceback, lv);
+        }
+
+        lily_deref(&hidden[0]);
+        lily_deref(&hidden[1]);
+        hidden[0].flags = 0;
+        hidden[1].flags = 0;
+        ival->extra_space = 0;
+    }
+
+    lily_value_assign(result_reg, traceback);
+}
+
+static void restore_from_exception(lily_vm_state *vm, lily_call_frame *frame,
+        uint16_t *code)
+{
     if (*code == o_exception_store) {
         lily_value *catch_reg = frame->start[code[1]];
 
@@ -1448,10 +1611,65 @@ static void restore_from_exception(lily_vm_state *vm,
     vm->exception_cls = NULL;
     vm->call_chain = frame;
     vm->call_chain->code = code;
-    vm->catch_chain = entry;
-    vm->raiser->all_jumps = entry->jump_entry;
+    vm->raiser->all_jumps = frame->jump;
+
+    longjmp(frame->jump->jump, 1);
+}
+
+/* Search the catch table of a native frame for an except clause that takes the
+   class given. The result is where that except clause's code begins, or NULL
+   if there isn't one. */
+static uint16_t *find_except(lily_vm_state *vm, lily_call_frame *frame,
+        lily_class *raised_cls)
+{
+    uint16_t *table = frame->function->proto->catch_table;
+    uint16_t *code = frame->function->code;
+
+    /* Native frames always have their code set when an exception is raised.
+       The position is backed up into the instruction that was running. */
+    uint16_t pos = (uint16_t)(frame->code - code - 1);
+    uint16_t i;
+
+    /* Inner try blocks come first, so the first hit is the closest one. */
+    for (i = 1;i < table[0];i += 3) {
+        if (pos < table[i] || pos >= table[i + 1])
+            continue;
+
+        uint16_t jump_location = table[i + 2];
+
+        /* The last except block will set this to 0. */
+        uint16_t move_by;
+
+        do {
+            lily_class *catch_class =
+                    vm->gs->class_table[code[jump_location + 1]];
 
-    longjmp(entry->jump_entry->jump, 1);
+            /* Caught it. Add +4 to begin in the except block. */
+            if (lily_class_greater_eq(catch_class, raised_cls))
+                return code + jump_location + 4;
+
+            move_by = code[jump_location + 2];
+            jump_location += move_by;
+        } while (move_by);
+    }
+
+    return NULL;
+}
+
+/* This is a callback registered by a foreign function. Fix the vm so that the
+   callback can use the foreign function's values. */
+static void run_error_callback(lily_vm_state *vm, lily_vm_catch_entry *entry)
+{
+    lily_call_frame *save_frame = vm->call_chain;
+
+    /* Restore locals to their original state. */
+    vm->call_chain = entry->call_frame;
+
+    /* lily_ec_exception_message uses these for traceback. */
+    entry->call_frame = save_frame;
+    vm->catch_chain = entry;
+    entry->callback_func(vm);
+    vm->call_chain = save_frame;
 }
 
 /* An exception has been raised. Figure out what will catch it, or bail. */
@@ -1459,52 +1677,32 @@ static void dispatch_exception(lily_vm_state *vm)
 {
     lily_class *raised_cls = vm->exception_cls;
     lily_vm_catch_entry *catch_iter = vm->catch_chain->prev;
+    lily_call_frame *frame_iter = vm->call_chain;
 
-    while (catch_iter != NULL) {
-        if (catch_iter->catch_kind == catch_native) {
-            lily_call_frame *call_frame = catch_iter->call_frame;
-            uint16_t *code = call_frame->function->code;
-
-            /* The code position is at the end of the try block. Go there, then
-               follow that jump to get to the first except. */
-            uint16_t jump_location =
-                    catch_iter->code_pos + code[catch_iter->code_pos] - 1;
+    /* Walk the frames from the most recent to least. Depth 0 is the toplevel,
+       which is not a function. */
+    for (;frame_iter->depth >= 1;frame_iter = frame_iter->prev) {
+        /* Callbacks are run before any native function below the foreign
+           function that registered them. */
+        while (catch_iter != NULL &&
+               catch_iter->call_frame->depth >= frame_iter->depth) {
+            run_error_callback(vm, catch_iter);
+            catch_iter = catch_iter->prev;
+        }
 
-            /* The last except block will set this to 0. */
-            uint16_t move_by = 1;
+        if (frame_iter->function->has_catch == 0 ||
+            frame_iter->function->code == NULL)
+            continue;
 
-            do {
-                lily_class *catch_class =
-                        vm->gs->class_table[code[jump_location + 1]];
+        uint16_t *code = find_except(vm, frame_iter, raised_cls);
 
-                if (lily_class_greater_eq(catch_class, raised_cls) == 0) {
-                    move_by = code[jump_location + 2];
-                    jump_location += move_by;
-                }
-                else {
-                    /* Caught it. Add +4 to begin in the except block. */
-                    code += jump_location + 4;
-
-                    /* Won't return from here. */
-                    restore_from_exception(vm, catch_iter, code);
-                }
-            } while (move_by);
-        }
-        else {
-            /* This is a callback registered by a foreign function. Fix the vm
-               so that the callback can use the foreign function's values. */
-            lily_call_frame *save_frame = vm->call_chain;
-
-            /* Restore locals to their original state. */
-            vm->call_chain = catch_iter->call_frame;
-
-            /* lily_ec_exception_message uses these for traceback. */
-            catch_iter->call_frame = save_frame;
-            vm->catch_chain = catch_iter;
-            catch_iter->callback_func(vm);
-            vm->call_chain = save_frame;
-        }
+        /* Won't return from here. */
+        if (code)
+            restore_from_exception(vm, frame_iter, code);
+    }
 
+    while (catch_iter != NULL) {
+        run_error_callback(vm, catch_iter);
         catch_iter = catch_iter->prev;
     }
 
@@ -1599,7 +1797,7 @@ void lily_vm_coroutine_error(lily_vm_state *origin, lily_coroutine_val *co_val)
 
     lily_container_val *con = lily_push_some(origin);
 
-    store_exception_into(co_val->vm, con->values[0]);
+    store_exception_into(co_val->vm, &con->values[0]);
 }
 
 lily_vm_state *lily_vm_coroutine_build(lily_vm_state *vm, uint16_t id)
@@ -1677,7 +1875,7 @@ static void resumption_failed(lily_vm_state *origin, lily_coroutine_val *co_val)
 
     /* Fake an error to use exception machinery. */
     origin->exception_cls = coerror_cls;
-    store_exception_into(origin, con->values[0]);
+    store_exception_into(origin, &con->values[0]);
     origin->exception_cls = NULL;
 }
 
@@ -1738,10 +1936,36 @@ void lily_vm_coroutine_resume(lily_vm_state *origin, lily_coroutine_val *co_val,
     else {
         lily_container_val *con = lily_push_failure(origin);
 
-        store_exception_into(co_val->vm, con->values[0]);
+        store_exception_into(co_val->vm, &con->values[0]);
     }
 }
 
+int lily_vm_coroutine_in_foreign_call(lily_vm_state *vm)
+{
+    /* A Coroutine vm always has at least two jumps active: The base jump that
+       resume sets, and the vm main loop. More than that means there's a foreign
+       call in between, and the Coroutine cannot be restored. */
+    return vm->raiser->all_jumps->prev->prev != NULL;
+}
+
+/* This suspends the Coroutine that 'vm' belongs to from inside of a foreign
+   function that it called directly. The caller's code is moved back to the
+   start of the call, so resuming the Coroutine calls the foreign function again
+   with the same arguments. 'count' is the number of arguments in that call.
+   Callers must check lily_vm_coroutine_in_foreign_call first. */
+void lily_vm_coroutine_suspend(lily_vm_state *vm, uint16_t count)
+{
+    lily_raiser *raiser = vm->raiser;
+
+    /* A call is the opcode, target, count, arguments, line, then result. */
+    vm->call_chain->prev->code -= count + 5;
+
+    /* Resume expects the yielded value at the top of the stack. */
+    lily_push_unit(vm);
+    lily_release_jump(raiser);
+    longjmp(raiser->all_jumps->jump, 1);
+}
+
 /***
  *      _____              _                  _    ____ ___
  *     |  ___|__  _ __ ___(_) __ _ _ __      / \  |  _ \_ _|
@@ -1826,6 +2050,7 @@ void lily_call(lily_vm_state *vm, uint16_t count)
 
     final_setup_before_call(vm, count);
     vm->call_chain = target_frame;
+    PROFILE_CALL(target_fn);
 
     if (target_fn->code == NULL) {
         target_fn->foreign_func(vm);
@@ -1858,7 +2083,6 @@ void lily_error_callback_push(lily_state *s, lily_error_callback_func func)
     lily_vm_catch_entry *catch_entry = s->catch_chain;
     catch_entry->call_frame = s->call_chain;
     catch_entry->callback_func = func;
-    catch_entry->catch_kind = catch_callback;
 
     s->catch_chain = s->catch_chain->next;
 }
@@ -1868,6 +2092,121 @@ void lily_error_callback_pop(lily_state *s)
     s->catch_chain = s->catch_chain->prev;
 }
 
+/***
+ *   __        __         _
+ *   \ \      / /__  _ __| | _____ _ __ ___
+ *    \ \ /\ / / _ \| '__| |/ / _ \ '__/ __|
+ *     \ V  V / (_) | |  |   <  __/ |  \__ \
+ *      \_/\_/ \___/|_|  |_|\_\___|_|  |___/
+ *
+ */
+
+/** A worker vm lets another thread call a parallel-safe foreign function. Like
+    a coroutine vm, it shares the global state of the vm that built it, but has
+    registers and a raiser of its own.
+
+    Parallel-safe functions only read their arguments, so arguments are lent to
+    the worker instead of being ref'd. That keeps threads from racing on the
+    refcount of values that they share. The results are new values that only the
+    worker knows about, until the threads are joined. **/
+
+lily_vm_state *lily_vm_worker_build(lily_vm_state *vm)
+{
+    lily_vm_state *worker = new_vm_state(lily_new_raiser(),
+            INITIAL_REGISTER_COUNT);
+    lily_class *save_cls = vm->exception_cls;
+    uint8_t id;
+
+    worker->gs = vm->gs;
+    worker->depth_max = vm->depth_max;
+
+    /* Loading an exception may need the parser, which can't be shared. Load
+       them all now so that a raise from the worker won't need to. */
+    for (id = LILY_ID_EXCEPTION;id <= LILY_ID_DBZERROR;id++)
+        load_exception(vm, id);
+
+    vm->exception_cls = save_cls;
+    return worker;
+}
+
+void lily_vm_worker_free(lily_vm_state *worker)
+{
+    lily_free_raiser(worker->raiser);
+    lily_destroy_vm(worker);
+    lily_free(worker);
+}
+
+/* Call 'func' with each of the 'count' values in 'input', writing results into
+   'output'. This can run on any thread. The result is 1 on success, or 0 if
+   'func' raised. Inputs are lent without a ref, which is why 'func' must be
+   parallel (see is_parallel). Callers finish with lily_vm_worker_adopt. */
+int lily_vm_worker_map(lily_vm_state *worker, lily_function_val *func,
+        lily_value *input, lily_value *output, uint32_t count)
+{
+    lily_jump_link *jump_base = worker->raiser->all_jumps;
+
+    if (setjmp(jump_base->jump))
+        return 0;
+
+    lily_call_prepare(worker, func);
+
+    lily_call_frame *target_frame = worker->call_chain->next;
+    uint32_t i;
+
+    for (i = 0;i < count;i++) {
+        lily_push_unit(worker);
+
+        lily_value *arg = lily_stack_get_top(worker);
+
+        *arg = input[i];
+        arg->flags &= ~VAL_IS_DEREFABLE;
+
+        /* This is lily_call, without a profile count that could race. */
+        final_setup_before_call(worker, 1);
+        worker->call_chain = target_frame;
+        func->foreign_func(worker);
+        worker->call_chain = target_frame->prev;
+
+        lily_value_assign(&output[i], target_frame->return_target);
+    }
+
+    return 1;
+}
+
+/* Workers lend each input without a ref, so a result that is the input it was
+   made from doesn't own it. This runs on the calling thread once the workers
+   are done, and gives those results the ref they're missing. */
+void lily_vm_worker_adopt(lily_value *input, lily_value *output,
+        uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0;i < count;i++) {
+        lily_value *in = &input[i];
+        lily_value *out = &output[i];
+
+        if ((in->flags & VAL_IS_DEREFABLE) &&
+            (out->flags & VAL_IS_DEREFABLE) == 0 &&
+            FLAGS_TO_BASE(out) == FLAGS_TO_BASE(in) &&
+            out->value.generic == in->value.generic) {
+            out->flags |= VAL_IS_DEREFABLE;
+            out->value.generic->refcount++;
+        }
+    }
+}
+
+/* Raise the exception that 'worker' raised from 'vm' instead. The worker is
+   freed before the raise. */
+void lily_vm_worker_raise(lily_vm_state *vm, lily_vm_state *worker)
+{
+    lily_msgbuf *msgbuf = lily_mb_flush(vm->raiser->msgbuf);
+
+    lily_mb_add(msgbuf, lily_mb_raw(worker->raiser->msgbuf));
+    vm->exception_cls = worker->exception_cls;
+    lily_vm_worker_free(worker);
+    dispatch_exception(vm);
+}
+
 /***
  *      ____
  *     |  _ \ _ __ ___ _ __
@@ -1947,8 +2286,9 @@ if (lhs_reg->flags & V_NUMERIC_FLAG) { \
     i = lhs_reg->value.integer OP rhs_reg->value.integer; \
 } \
 else if (lhs_reg->flags & V_STRING_FLAG) { \
-    i = strcmp(lhs_reg->value.string->string, \
-               rhs_reg->value.string->string) OP 0; \
+    i = (lhs_reg->value.string == rhs_reg->value.string || \
+         strcmp(lhs_reg->value.string->string, \
+                rhs_reg->value.string->string) == 0) OP 1; \
 } \
 else if (lhs_reg->flags == LILY_ID_DOUBLE) { \
     i = lhs_reg->value.doubleval OP rhs_reg->value.doubleval; \
@@ -1982,6 +2322,40 @@ if (i) \
 else \
     code += code[3];
 
+#ifdef LILY_WITH_PROFILE
+static void profile_dispatch(lily_vm_state *vm, lily_call_frame *frame,
+        uint16_t *code)
+{
+    vm->gs->profile_opcodes[code[0]]++;
+
+    /* Frames returning to a foreign caller exit through code that isn't in
+       their function. The exit of __main__ isn't interesting either. */
+    if (code[0] == o_vm_exit)
+        return;
+
+    lily_function_val *f = frame->function;
+    lily_proto *proto = f->proto;
+
+    if (proto->profile_hits == NULL) {
+        uint32_t size = f->code_len;
+
+        proto->profile_hits = lily_malloc(size * sizeof(*proto->profile_hits));
+        memset(proto->profile_hits, 0, size * sizeof(*proto->profile_hits));
+        proto->profile_hits_len = size;
+    }
+
+    proto->profile_hits[code - f->code]++;
+}
+#endif
+
+/* The sampler's countdown ran out, so record the stack and start counting
+   again. */
+static void sample_point(lily_vm_state *vm, uint16_t *code)
+{
+    lily_profile_take_sample(vm, code);
+    vm->gs->sample_countdown = vm->gs->sample_interval;
+}
+
 /* This is where native code is executed. Simple opcodes are handled here, while
    complex opcodes are handled in do_o_* functions.
    Native functions work by pushing data onto the vm's stack and moving the
@@ -1997,18 +2371,32 @@ void lily_vm_execute(lily_vm_state *vm)
     lily_function_val *fval;
     lily_value **upvalues;
     lily_call_frame *current_frame, *next_frame;
-    lily_jump_link *link = lily_jump_setup(vm->raiser);
+    lily_jump_link *link = NULL;
+
+    /* A jump is only needed when a function with a try block is entered,
+       because only caught exceptions come back here. Foreign functions like
+       List.map enter here once per element, and usually don't need one.
+       Coroutines always take a jump, because yield counts them to know if it is
+       in a foreign call. */
+    if (vm != vm->gs->first_vm || vm->call_chain->function->has_catch)
+        link = lily_jump_setup(vm->raiser);
+
+    jump_setup:
 
     /* If an exception is caught, the vm's state is fixed before sending control
        back here. There's no need for a condition around this setjmp call. */
-    setjmp(link->jump);
+    if (link)
+        setjmp(link->jump);
 
     current_frame = vm->call_chain;
+    current_frame->jump = link;
     code = current_frame->code;
     upvalues = current_frame->function->upvalues;
     vm_regs = vm->call_chain->start;
 
     while (1) {
+        PROFILE_DISPATCH;
+
         switch(code[0]) {
             case o_assign_noref:
                 rhs_reg = vm_regs[code[1]];
@@ -2080,6 +2468,7 @@ void lily_vm_execute(lily_vm_state *vm)
                 break;
             case o_jump:
                 code += (int16_t)code[1];
+                SAMPLE_POINT;
                 break;
             case o_int_multiply:
                 INTEGER_OP(*)
@@ -2151,8 +2540,11 @@ void lily_vm_execute(lily_vm_state *vm)
                     else
                         result = (lhs_reg->value.doubleval == 0.0);
 
-                    if (result != code[1])
+                    /* do while loops go back through here. */
+                    if (result != code[1]) {
                         code += (int16_t)code[3];
+                        SAMPLE_POINT;
+                    }
                     else
                         code += 4;
                 }
@@ -2162,6 +2554,7 @@ void lily_vm_execute(lily_vm_state *vm)
 
                 foreign_func_body: ;
 
+                PROFILE_CALL(fval);
                 vm_setup_before_call(vm, code);
                 next_frame = current_frame->next;
                 next_frame->function = fval;
@@ -2174,6 +2567,7 @@ void lily_vm_execute(lily_vm_state *vm)
 
                 prep_registers(current_frame, code);
                 vm->call_chain = next_frame;
+                SAMPLE_POINT;
 
                 fval->foreign_func(vm);
 
@@ -2187,9 +2581,19 @@ void lily_vm_execute(lily_vm_state *vm)
 
                 native_func_body: ;
 
+                if (fval->has_catch && link == NULL) {
+                    /* Take a jump, then come back here through the state
+                       reload that caught exceptions use. */
+                    link = lily_jump_setup(vm->raiser);
+                    current_frame->code = code;
+                    goto jump_setup;
+                }
+
+                PROFILE_CALL(fval);
                 vm_setup_before_call(vm, code);
                 next_frame = current_frame->next;
                 next_frame->function = fval;
+                next_frame->jump = link;
                 next_frame->top = next_frame->start + fval->reg_count;
 
                 if (next_frame->top >= next_frame->register_end) {
@@ -2204,12 +2608,22 @@ void lily_vm_execute(lily_vm_state *vm)
                 vm_regs = current_frame->start;
                 code = fval->code;
                 upvalues = fval->upvalues;
+                SAMPLE_POINT;
 
                 break;
             }
             case o_call_register:
                 fval = vm_regs[code[1]]->value.function;
 
+                if (fval->code != NULL)
+                    goto native_func_body;
+                else
+                    goto foreign_func_body;
+
+                break;
+            case o_call_virt:
+                fval = vm_regs[code[3]]->value.vt_container->virts[code[1]];
+
                 if (fval->code != NULL)
                     goto native_func_body;
                 else
@@ -2288,20 +2702,127 @@ void lily_vm_execute(lily_vm_state *vm)
                 lily_value_assign(lhs_reg, rhs_reg);
                 code += 4;
                 break;
-            case o_subscript_get:
-                /* Might raise IndexError or KeyError. */
+            case o_list_get:
+                lhs_reg = vm_regs[code[1]];
+                rhs_reg = vm_regs[code[2]];
+                {
+                    lily_container_val *list_val = lhs_reg->value.container;
+                    int64_t index = rhs_reg->value.integer;
+
+                    if ((uint64_t)index >= list_val->num_values) {
+                        SAVE_LINE(+5);
+                        index = fix_index(vm, index, list_val->num_values);
+                    }
+
+                    lily_value_assign(vm_regs[code[3]],
+                            &list_val->values[index]);
+                }
+                code += 5;
+                break;
+            case o_list_set:
+                lhs_reg = vm_regs[code[1]];
+                rhs_reg = vm_regs[code[2]];
+                {
+                    lily_container_val *list_val = lhs_reg->value.container;
+                    int64_t index = rhs_reg->value.integer;
+
+                    if ((uint64_t)index >= list_val->num_values) {
+                        SAVE_LINE(+5);
+                        index = fix_index(vm, index, list_val->num_values);
+                    }
+
+                    lily_value_assign(&list_val->values[index],
+                            vm_regs[code[3]]);
+                }
+                code += 5;
+                break;
+            case o_bytestring_get:
+                lhs_reg = vm_regs[code[1]];
+                rhs_reg = vm_regs[code[2]];
+                {
+                    lily_string_val *sv = lhs_reg->value.string;
+                    int64_t index = rhs_reg->value.integer;
+
+                    if ((uint64_t)index >= sv->size) {
+                        SAVE_LINE(+5);
+                        index = fix_index(vm, index, sv->size);
+                    }
+
+                    move_byte(vm_regs[code[3]], (uint8_t)sv->string[index]);
+                }
+                code += 5;
+                break;
+            case o_bytestring_set:
+                lhs_reg = vm_regs[code[1]];
+                rhs_reg = vm_regs[code[2]];
+                {
+                    lily_string_val *sv = lhs_reg->value.string;
+                    int64_t index = rhs_reg->value.integer;
+
+                    if ((uint64_t)index >= sv->size) {
+                        SAVE_LINE(+5);
+                        index = fix_index(vm, index, sv->size);
+                    }
+
+                    sv->string[index] = (char)vm_regs[code[3]]->value.integer;
+                }
+                code += 5;
+                break;
+            case o_hash_get:
+                /* Might raise KeyError. */
                 SAVE_LINE(+5);
-                do_o_subscript_get(vm, code);
+                do_o_hash_get(vm, code);
+                code += 5;
+                break;
+            case o_hash_set:
+                lily_hash_set(vm, vm_regs[code[1]]->value.hash,
+                        vm_regs[code[2]], vm_regs[code[3]]);
+                code += 5;
+                break;
+            case o_hash_get_literal:
+                /* Might raise KeyError. */
+                SAVE_LINE(+9);
+                do_o_hash_get_literal(vm, code);
+                code += 9;
+                break;
+            case o_list_get_literal:
+                lhs_reg = vm_regs[code[2]];
+                {
+                    lily_container_val *list_val = lhs_reg->value.container;
+                    int64_t index = (int16_t)code[1];
+
+                    if ((uint64_t)index >= list_val->num_values) {
+                        SAVE_LINE(+5);
+                        index = fix_index(vm, index, list_val->num_values);
+                    }
+
+                    lily_value_assign(vm_regs[code[3]],
+                            &list_val->values[index]);
+                }
+                code += 5;
+                break;
+            case o_list_set_literal:
+                lhs_reg = vm_regs[code[2]];
+                {
+                    lily_container_val *list_val = lhs_reg->value.container;
+                    int64_t index = (int16_t)code[1];
+
+                    if ((uint64_t)index >= list_val->num_values) {
+                        SAVE_LINE(+5);
+                        index = fix_index(vm, index, list_val->num_values);
+                    }
+
+                    lily_value_assign(&list_val->values[index],
+                            vm_regs[code[3]]);
+                }
                 code += 5;
                 break;
             case o_property_get:
                 do_o_property_get(vm, code);
                 code += 5;
                 break;
-            case o_subscript_set:
-                /* Might raise IndexError or KeyError. */
-                SAVE_LINE(+5);
-                do_o_subscript_set(vm, code);
+            case o_traceback_get:
+                do_o_traceback_get(vm, code);
                 code += 5;
                 break;
             case o_property_set:
@@ -2317,6 +2838,10 @@ void lily_vm_execute(lily_vm_state *vm)
                 do_o_build_list_tuple(vm, code);
                 code += code[1] + 4;
                 break;
+            case o_build_tuple_local:
+                do_o_build_tuple_local(vm, code);
+                code += code[1] + 4;
+                break;
             case o_build_variant:
                 do_o_build_variant(vm, code);
                 code += code[2] + 5;
@@ -2357,7 +2882,7 @@ void lily_vm_execute(lily_vm_state *vm)
                 for_temp = loop_reg->value.integer;
 
                 if (for_temp < rhs_reg->value.container->num_values) {
-                    rhs_reg = rhs_reg->value.container->values[for_temp];
+                    rhs_reg = &rhs_reg->value.container->values[for_temp];
                     lily_value_assign(lhs_reg, rhs_reg);
                     code += 6;
                 }
@@ -2410,27 +2935,6 @@ void lily_vm_execute(lily_vm_state *vm)
                     code += code[5];
 
                 break;
-            case o_catch_push:
-            {
-                if (vm->catch_chain->next == NULL)
-                    add_catch_entry(vm);
-
-                lily_vm_catch_entry *catch_entry = vm->catch_chain;
-                catch_entry->call_frame = current_frame;
-                catch_entry->code_pos = 1 +
-                        (uint16_t)(code - current_frame->function->code);
-                catch_entry->jump_entry = vm->raiser->all_jumps;
-                catch_entry->catch_kind = catch_native;
-
-                vm->catch_chain = vm->catch_chain->next;
-                code += 3;
-                break;
-            }
-            case o_catch_pop:
-                vm->catch_chain = vm->catch_chain->prev;
-
-                code++;
-                break;
             case o_exception_raise:
                 SAVE_LINE(+3);
                 lhs_reg = vm_regs[code[1]];
@@ -2493,7 +2997,8 @@ void lily_vm_execute(lily_vm_state *vm)
                 code += 4;
                 break;
             case o_vm_exit:
-                lily_release_jump(vm->raiser);
+                if (link)
+                    lily_release_jump(vm->raiser);
             default:
                 return;
         }
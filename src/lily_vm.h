@@ -24,6 +24,9 @@ typedef struct lily_call_frame_ {
        number of any native frame can be obtained through code[-1]. */
     uint16_t *code;
     lily_function_val *function;
+    /* The jump of the vm loop running this frame. This is only set if the
+       function has a catch table, because that's when it's needed. */
+    lily_jump_link *jump;
     /* A value from the previous frame to return back into. */
     lily_value *return_target;
     /* Call depth of this frame (global toplevel is 0, __main__ is 1). */
@@ -35,21 +38,12 @@ typedef struct lily_call_frame_ {
     struct lily_call_frame_ *next;
 } lily_call_frame;
 
-typedef enum {
-    catch_native,
-    catch_callback
-} lily_catch_kind;
-
+/* Catch entries hold error callbacks that foreign functions have registered.
+   Native functions find their except clauses through the catch table of their
+   proto instead. */
 typedef struct lily_vm_catch_entry_ {
     lily_call_frame *call_frame;
-    uint16_t code_pos;
-    lily_catch_kind catch_kind : 16;
-    uint32_t pad;
-
-    union {
-        lily_jump_link *jump_entry;
-        lily_error_callback_func callback_func;
-    };
+    lily_error_callback_func callback_func;
 
     struct lily_vm_catch_entry_ *next;
     struct lily_vm_catch_entry_ *prev;
@@ -86,12 +80,40 @@ typedef struct lily_global_state_ {
        the threshold is multiplied by to increase it. */
     uint32_t gc_multiplier;
 
+    /* How many sweeps have been done. */
+    uint32_t gc_sweep_count;
+
+    /* How many values have been tagged. This is never reset, so the bench
+       package can take the difference across a call. */
+    uint64_t gc_tag_count;
+
     /* The id of the global register that stdout is in, or UINT16_MAX if stdout
        is not in a register. */
     uint16_t stdout_reg_spot;
 
     uint16_t pad;
 
+    /* How many literals String.intern has seen. String literals are added to
+       the intern table before anything else so that they win. */
+    uint32_t intern_literal_pos;
+
+    /* String.intern's table, or NULL before the first call. Each String maps
+       to the one that equal Strings are swapped for. */
+    lily_hash_val *intern_table;
+
+    /* Stacks recorded by the sampler, or NULL if there aren't any yet. */
+    struct lily_profile_samples_ *profile_samples;
+
+    /* The sampler records a stack every time the countdown reaches zero, then
+       resets it to the interval. A countdown of 0 means it is off. */
+    uint32_t sample_interval;
+    uint32_t sample_countdown;
+
+#ifdef LILY_WITH_PROFILE
+    /* Profiling builds only. How many times each opcode has been dispatched. */
+    uint64_t *profile_opcodes;
+#endif
+
     struct lily_vm_state_ *first_vm;
 
     /* This is used to dynaload exceptions when absolutely necessary. */
@@ -136,6 +158,15 @@ void lily_vm_coroutine_call_prep(lily_vm_state *, uint16_t);
 void lily_vm_coroutine_error(lily_vm_state *, lily_coroutine_val *);
 void lily_vm_coroutine_resume(lily_vm_state *, lily_coroutine_val *,
         lily_value *);
+int lily_vm_coroutine_in_foreign_call(lily_vm_state *);
+void lily_vm_coroutine_suspend(lily_vm_state *, uint16_t);
+
+lily_vm_state *lily_vm_worker_build(lily_vm_state *);
+void lily_vm_worker_free(lily_vm_state *);
+int lily_vm_worker_map(lily_vm_state *, lily_function_val *, lily_value *,
+        lily_value *, uint32_t);
+void lily_vm_worker_raise(lily_vm_state *, lily_vm_state *);
+void lily_vm_worker_adopt(lily_value *, lily_value *, uint32_t);
 
 void lily_vm_execute(lily_vm_state *);
 
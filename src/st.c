@@ -143,8 +143,11 @@ static int cmp_str(lily_raw_value raw_left, lily_raw_value raw_right)
     lily_string_val *left_sv = raw_left.string;
     lily_string_val *right_sv = raw_right.string;
 
-    return left_sv->size != right_sv->size &&
-           strcmp(left_sv->string, right_sv->string) != 0;
+    if (left_sv == right_sv)
+        return 0;
+
+    return left_sv->size != right_sv->size ||
+           memcmp(left_sv->string, right_sv->string, left_sv->size) != 0;
 }
 
 static void rehash(lily_hash_val *table)
@@ -250,6 +253,27 @@ void lily_hash_set_from_stack(lily_state *s, lily_hash_val *table)
     key->flags = 0;
 }
 
+uint64_t lily_hash_for_string(const char *sipkey, lily_string_val *sv)
+{
+    return siphash24(sv->string, sv->size, sipkey);
+}
+
+lily_value *lily_hash_get_with_hash(lily_hash_val *table,
+        lily_value *boxed_key, uint64_t hash_out)
+{
+    unsigned int bin_pos;
+    register lily_hash_entry *ptr;
+    lily_raw_value key = boxed_key->value;
+    int (*cmp_fn)(lily_raw_value, lily_raw_value) = cmp_str;
+
+    FIND_ENTRY(table, ptr, hash_out, bin_pos);
+
+    if (ptr)
+        return ptr->record;
+    else
+        return NULL;
+}
+
 lily_value *lily_hash_get(lily_state *s, lily_hash_val *table,
         lily_value *boxed_key)
 {
@@ -234,6 +234,16 @@ void lily_backbone_Interpreter_config_set_extra_info(lily_state *s)
     lily_return_value(s, interp);
 }
 
+void lily_backbone_Interpreter_config_set_optimize(lily_state *s)
+{
+    lily_value *interp = lily_arg_value(s, 0);
+    int value = (int)lily_arg_integer(s, 1);
+    lily_backbone_RawInterpreter *raw = unpack_rawinterp(s);
+
+    raw->config.optimize = value;
+    lily_return_value(s, interp);
+}
+
 void lily_backbone_Interpreter_error(lily_state *s)
 {
     lily_backbone_RawInterpreter *raw = unpack_rawinterp(s);
@@ -509,6 +519,23 @@ void lily_backbone_Interpreter_parse_string(lily_state *s)
     lily_return_boolean(s, result);
 }
 
+void lily_backbone_Interpreter_profile_collapsed(lily_state *s)
+{
+    lily_backbone_RawInterpreter *raw = unpack_rawinterp(s);
+
+    lily_push_string(s, lily_profile_collapsed(raw->subi));
+    lily_return_top(s);
+}
+
+void lily_backbone_Interpreter_profile_sample_every(lily_state *s)
+{
+    lily_backbone_RawInterpreter *raw = unpack_rawinterp(s);
+    int64_t count = lily_arg_integer(s, 1);
+
+    lily_profile_sample_every(raw->subi, (uint32_t)count);
+    lily_return_unit(s);
+}
+
 void lily_backbone_Interpreter_validate_file(lily_state *s)
 {
     lily_backbone_RawInterpreter *raw = unpack_rawinterp(s);
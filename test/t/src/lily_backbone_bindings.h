@@ -60,9 +60,10 @@ lily_push_super(s_, ID_TestCaseBase(s_), 3)
 LILY_BACKBONE_EXPORT
 const char *lily_backbone_info_table[] = {
     "\3Interpreter\0RawInterpreter\0TestCaseBase\0"
-    ,"N\33Interpreter\0"
+    ,"N\36Interpreter\0"
     ,"m\0<new>\0: Interpreter"
     ,"m\0config_set_extra_info\0(Interpreter,Boolean): Interpreter"
+    ,"m\0config_set_optimize\0(Interpreter,Boolean): Interpreter"
     ,"m\0error\0(Interpreter): String"
     ,"m\0error_message\0(Interpreter): String"
     ,"m\0exit_code\0(Interpreter): Byte"
@@ -84,6 +85,8 @@ const char *lily_backbone_info_table[] = {
     ,"m\0parse_manifest_file\0(Interpreter,String): Boolean"
     ,"m\0parse_manifest_string\0(Interpreter,String,String): Boolean"
     ,"m\0parse_string\0(Interpreter,String,String): Boolean"
+    ,"m\0profile_collapsed\0(Interpreter): String"
+    ,"m\0profile_sample_every\0(Interpreter,Integer)"
     ,"m\0validate_file\0(Interpreter,String): Boolean"
     ,"m\0validate_string\0(Interpreter,String,String): Boolean"
     ,"1\0import_hook\0Function(Interpreter,String)"
@@ -104,6 +107,7 @@ lily_call_entry_func lily_backbone_call_table[] = { \
     NULL, \
     lily_backbone_new_Interpreter, \
     lily_backbone_Interpreter_config_set_extra_info, \
+    lily_backbone_Interpreter_config_set_optimize, \
     lily_backbone_Interpreter_error, \
     lily_backbone_Interpreter_error_message, \
     lily_backbone_Interpreter_exit_code, \
@@ -125,6 +129,8 @@ lily_call_entry_func lily_backbone_call_table[] = { \
     lily_backbone_Interpreter_parse_manifest_file, \
     lily_backbone_Interpreter_parse_manifest_string, \
     lily_backbone_Interpreter_parse_string, \
+    lily_backbone_Interpreter_profile_collapsed, \
+    lily_backbone_Interpreter_profile_sample_every, \
     lily_backbone_Interpreter_validate_file, \
     lily_backbone_Interpreter_validate_string, \
     NULL, \
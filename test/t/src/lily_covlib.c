@@ -142,6 +142,16 @@ void lily_covlib__cover_id_checks(lily_state *s)
     lily_return_boolean(s, ok);
 }
 
+void lily_covlib__cover_parallel_divide(lily_state *s)
+{
+    int64_t value = lily_arg_integer(s, 0);
+
+    if (value == 0)
+        lily_DivisionByZeroError(s, "Attempt to divide by zero.");
+
+    lily_return_integer(s, 1000 / value);
+}
+
 void lily_covlib__cover_push_boolean(lily_state *s)
 {
     lily_push_boolean(s, 1);
@@ -139,6 +139,7 @@ const char *lily_covlib_info_table[] = {
     ,"F\0cover_optional_integer\0(*Integer,:b *Integer,:c *Integer): Integer"
     ,"F\0cover_optional_keyarg_call\0(Function(*Integer,*Integer,*Integer=>Integer)): Integer"
     ,"F\0cover_optional_string\0(*String,:b *String,:c *String): String"
+    ,"P\0cover_parallel_divide\0(Integer): Integer"
     ,"F\0cover_push_boolean\0: Boolean"
     ,"F\0cover_value_as\0(Byte,ByteString,Exception,Double,File,Function(Integer),Foreign,Hash[Integer,Integer],Integer,String)"
     ,"F\0cover_value_group\0(Boolean,Byte,ByteString,Double,Option[Integer],File,Function(Integer),Hash[Integer,Integer],Foreign,Exception,Integer,List[Integer],String,Tuple[Integer],Unit,Option[Integer]): Boolean"
@@ -201,6 +202,7 @@ lily_call_entry_func lily_covlib_call_table[] = { \
     lily_covlib__cover_optional_integer, \
     lily_covlib__cover_optional_keyarg_call, \
     lily_covlib__cover_optional_string, \
+    lily_covlib__cover_parallel_divide, \
     lily_covlib__cover_push_boolean, \
     lily_covlib__cover_value_as, \
     lily_covlib__cover_value_group, \
@@ -36,13 +36,16 @@ const char *all_test_paths[] =
     TEST("method",      "test_option"),
     TEST("method",      "test_result"),
     TEST("method",      "test_string"),
+    TEST("prelude",     "test_pkg_bench"),
     TEST("prelude",     "test_pkg_coroutine"),
     TEST("prelude",     "test_pkg_fs"),
     TEST("prelude",     "test_pkg_introspect"),
+    TEST("prelude",     "test_pkg_io"),
     TEST("prelude",     "test_pkg_math"),
     TEST("prelude",     "test_pkg_random"),
     TEST("prelude",     "test_pkg_subprocess"),
     TEST("prelude",     "test_pkg_sys"),
+    TEST("prelude",     "test_pkg_thread"),
     TEST("prelude",     "test_pkg_time"),
     TEST("prelude",     "test_pkg_utf8"),
     TEST("call",        "test_call_pipe"),
@@ -0,0 +1,140 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lily.h"
+
+/* This runs several interpreters at once, each on its own thread. Interpreters
+   don't share any mutable state, so this should pass cleanly under a thread
+   sanitizer build (-DCMAKE_C_FLAGS=-fsanitize=thread). */
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_ROUNDS 25
+
+typedef struct {
+    int rounds;
+    int fail_count;
+} thread_data;
+
+/* This touches the type system, classes, closures, exceptions, the gc, and a
+   few predefined modules. It raises if any result is wrong. */
+static const char *stress_code =
+"import (Time) time\n"
+"\n"
+"class Point(public var @x: Integer, public var @y: Integer) {\n"
+"    public define sum: Integer { return @x + @y }\n"
+"}\n"
+"\n"
+"enum Tree {\n"
+"    Leaf,\n"
+"    Branch(Tree, Integer, Tree)\n"
+"}\n"
+"\n"
+"define total(t: Tree): Integer {\n"
+"    match t: {\n"
+"        case Leaf:\n"
+"            return 0\n"
+"        case Branch(l, v, r):\n"
+"            return total(l) + v + total(r)\n"
+"    }\n"
+"}\n"
+"\n"
+"var points: List[Point] = []\n"
+"var words: Hash[String, Integer] = []\n"
+"var caught = 0\n"
+"var tree: Tree = Tree.Leaf\n"
+"\n"
+"for i in 0...199: {\n"
+"    points.push(Point(i, 0))\n"
+"    words[i.to_s() ++ \"!\"] = i\n"
+"\n"
+"    if i < 50: {\n"
+"        tree = Tree.Branch(tree, i, Tree.Leaf)\n"
+"    }\n"
+"\n"
+"    try: {\n"
+"        var v = i / (i % 3)\n"
+"    except DivisionByZeroError:\n"
+"        caught += 1\n"
+"    }\n"
+"}\n"
+"\n"
+"var sum = points.fold(0, (|a, p| a + p.sum()))\n"
+"var t = Time.now()\n"
+"\n"
+"if sum != 19900 || words.size() != 200 || caught != 67 ||\n"
+"   total(tree) != 1225 || t.to_s().size() == 0: {\n"
+"    raise ValueError(\"Wrong result.\")\n"
+"}\n";
+
+static void *run_thread(void *arg)
+{
+    thread_data *td = arg;
+    int i;
+
+    for (i = 0;i < td->rounds;i++) {
+        lily_config config;
+
+        lily_config_init(&config);
+        config.gc_start = 16;
+
+        lily_state *s = lily_new_state(&config);
+
+        lily_load_string(s, "[thread]", stress_code);
+
+        if (lily_parse_content(s) == 0) {
+            fputs(lily_error_message(s), stdout);
+            td->fail_count++;
+            lily_free_state(s);
+            break;
+        }
+
+        lily_free_state(s);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int thread_count = DEFAULT_THREADS;
+    int rounds = DEFAULT_ROUNDS;
+
+    if (argc > 1)
+        thread_count = atoi(argv[1]);
+
+    if (argc > 2)
+        rounds = atoi(argv[2]);
+
+    if (thread_count <= 0 || rounds <= 0) {
+        fputs("Usage: thread-tests [threads [rounds]]\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_t *threads = malloc(thread_count * sizeof(*threads));
+    thread_data *data = malloc(thread_count * sizeof(*data));
+    int fail_count = 0;
+    int i;
+
+    for (i = 0;i < thread_count;i++) {
+        data[i].rounds = rounds;
+        data[i].fail_count = 0;
+        pthread_create(&threads[i], NULL, run_thread, &data[i]);
+    }
+
+    for (i = 0;i < thread_count;i++) {
+        pthread_join(threads[i], NULL);
+        fail_count += data[i].fail_count;
+    }
+
+    fprintf(stdout, "%d threads ran %d interpreters, %d failed.\n",
+            thread_count, thread_count * rounds, fail_count);
+
+    free(threads);
+    free(data);
+
+    if (fail_count)
+        exit(EXIT_FAILURE);
+
+    exit(EXIT_SUCCESS);
+}